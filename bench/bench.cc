@@ -0,0 +1,247 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The runner for the benchmarks in this directory. Usage:
+ *
+ *   jill_bench [--filter=SUBSTRING] [--min-time=SECONDS] [--format=console|json|tsv]
+ *              [--out=FILE]
+ *
+ * JSON output follows the layout of google-benchmark's, so the same tools can
+ * be used to compare runs. The library logs to stdout, so machine-readable
+ * output should be written to a file with --out.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "jill/version.hh"
+#include "bench.hh"
+
+using namespace bench;
+using std::string;
+using std::vector;
+
+state::state(boost::uint64_t iterations, vector<long> const & args)
+        : _iterations(iterations), _remaining(iterations), _args(args), _running(false),
+          _elapsed(0), _bytes(0), _items(0)
+{}
+
+namespace {
+
+FILE * out = stdout;
+
+boost::ptr_vector<benchmark> &
+registry()
+{
+        static boost::ptr_vector<benchmark> r;
+        return r;
+}
+
+struct result {
+        string name;
+        boost::uint64_t iterations;
+        double ns_per_iter;
+        double bytes_per_second;
+        double items_per_second;
+        string label;
+        string error;
+};
+
+string
+run_name(benchmark const & b, vector<long> const & args)
+{
+        string name = b.name();
+        char buf[32];
+        for (vector<long>::const_iterator it = args.begin(); it != args.end(); ++it) {
+                snprintf(buf, sizeof(buf), "/%ld", *it);
+                name += buf;
+        }
+        return name;
+}
+
+/* run with increasing iteration counts until the minimum time is reached */
+result
+run(benchmark const & b, vector<long> const & args, double min_time)
+{
+        result r;
+        r.name = run_name(b, args);
+        boost::uint64_t n = 1;
+        while (1) {
+                state s(n, args);
+                b.function()(s);
+                if (!s.error().empty()) {
+                        r.iterations = 0;
+                        r.ns_per_iter = r.bytes_per_second = r.items_per_second = 0;
+                        r.error = s.error();
+                        return r;
+                }
+                double elapsed = s.elapsed_ns() * 1e-9;
+                if (elapsed >= min_time || n >= 1000000000) {
+                        r.iterations = n;
+                        r.ns_per_iter = s.elapsed_ns() / n;
+                        r.bytes_per_second = (elapsed > 0) ? s.bytes_processed() / elapsed : 0;
+                        r.items_per_second = (elapsed > 0) ? s.items_processed() / elapsed : 0;
+                        r.label = s.label();
+                        return r;
+                }
+                // aim for 40% over the minimum, but don't grow too fast
+                double scale = (elapsed > 0) ? min_time * 1.4 / elapsed : 100;
+                if (scale > 100) scale = 100;
+                boost::uint64_t next = (boost::uint64_t)(n * scale);
+                n = (next > n) ? next : n + 1;
+        }
+}
+
+void
+print_json_string(string const & s)
+{
+        fputc('"', out);
+        for (string::const_iterator c = s.begin(); c != s.end(); ++c) {
+                if (*c == '"' || *c == '\\') fputc('\\', out);
+                fputc(*c, out);
+        }
+        fputc('"', out);
+}
+
+void
+print_json_header()
+{
+        char host[256] = "";
+        gethostname(host, sizeof(host));
+        fprintf(out, "{\n  \"context\": {\n    \"library_version\": ");
+        print_json_string(JILL_VERSION);
+        fprintf(out, ",\n    \"host_name\": ");
+        print_json_string(host);
+        fprintf(out, ",\n    \"num_cpus\": %ld\n  },\n  \"benchmarks\": [",
+                sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+void
+print_json(result const & r, bool first)
+{
+        fprintf(out, "%s\n    {\n      \"name\": ", first ? "" : ",");
+        print_json_string(r.name);
+        if (!r.error.empty()) {
+                fprintf(out, ",\n      \"error_occurred\": true,\n      \"error_message\": ");
+                print_json_string(r.error);
+                fprintf(out, "\n    }");
+                return;
+        }
+        fprintf(out, ",\n      \"iterations\": %llu,\n      \"real_time\": %.3f,"
+                "\n      \"time_unit\": \"ns\"", (unsigned long long)r.iterations, r.ns_per_iter);
+        if (r.bytes_per_second > 0)
+                fprintf(out, ",\n      \"bytes_per_second\": %.0f", r.bytes_per_second);
+        if (r.items_per_second > 0)
+                fprintf(out, ",\n      \"items_per_second\": %.0f", r.items_per_second);
+        if (!r.label.empty()) {
+                fprintf(out, ",\n      \"label\": ");
+                print_json_string(r.label);
+        }
+        fprintf(out, "\n    }");
+}
+
+void
+print_console(result const & r)
+{
+        if (!r.error.empty()) {
+                fprintf(out, "%-48s SKIPPED: %s\n", r.name.c_str(), r.error.c_str());
+                return;
+        }
+        fprintf(out, "%-48s %12.1f ns %12llu", r.name.c_str(), r.ns_per_iter,
+                (unsigned long long)r.iterations);
+        if (r.bytes_per_second > 0)
+                fprintf(out, " %9.1f MB/s", r.bytes_per_second / (1 << 20));
+        if (r.items_per_second > 0)
+                fprintf(out, " %9.3f M items/s", r.items_per_second * 1e-6);
+        if (!r.label.empty())
+                fprintf(out, " %s", r.label.c_str());
+        fputc('\n', out);
+}
+
+void
+print_tsv(result const & r)
+{
+        fprintf(out, "%s\t%llu\t%.3f\t%.0f\t%.0f\t%s\n", r.name.c_str(),
+                (unsigned long long)r.iterations, r.ns_per_iter, r.bytes_per_second,
+                r.items_per_second, r.error.empty() ? r.label.c_str() : r.error.c_str());
+}
+
+} // anonymous namespace
+
+benchmark *
+bench::add(string const & name, function_type fn)
+{
+        registry().push_back(new benchmark(name, fn));
+        return &registry().back();
+}
+
+int
+main(int argc, char ** argv)
+{
+        string filter, format = "console", outfile;
+        double min_time = 0.5;
+        for (int i = 1; i < argc; ++i) {
+                if (strncmp(argv[i], "--filter=", 9) == 0)
+                        filter = argv[i] + 9;
+                else if (strncmp(argv[i], "--min-time=", 11) == 0)
+                        min_time = atof(argv[i] + 11);
+                else if (strncmp(argv[i], "--format=", 9) == 0)
+                        format = argv[i] + 9;
+                else if (strncmp(argv[i], "--out=", 6) == 0)
+                        outfile = argv[i] + 6;
+                else {
+                        fprintf(stderr, "Usage: %s [--filter=SUBSTRING] [--min-time=SECONDS] "
+                                "[--format=console|json|tsv] [--out=FILE]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (format != "console" && format != "json" && format != "tsv") {
+                fprintf(stderr, "unknown output format: %s\n", format.c_str());
+                return EXIT_FAILURE;
+        }
+        if (!outfile.empty()) {
+                out = fopen(outfile.c_str(), "w");
+                if (out == 0) {
+                        perror(outfile.c_str());
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (format == "json")
+                print_json_header();
+        else if (format == "tsv")
+                fprintf(out, "name\titerations\tns_per_iter\tbytes_per_second\titems_per_second\tlabel\n");
+
+        bool first = true;
+        for (boost::ptr_vector<benchmark>::const_iterator b = registry().begin();
+             b != registry().end(); ++b) {
+                vector<vector<long> > argsets = b->argsets();
+                if (argsets.empty()) argsets.push_back(vector<long>());
+                for (vector<vector<long> >::const_iterator a = argsets.begin();
+                     a != argsets.end(); ++a) {
+                        if (!filter.empty() && run_name(*b, *a).find(filter) == string::npos)
+                                continue;
+                        result r = run(*b, *a, min_time);
+                        if (format == "json")
+                                print_json(r, first);
+                        else if (format == "tsv")
+                                print_tsv(r);
+                        else
+                                print_console(r);
+                        first = false;
+                        fflush(out);
+                }
+        }
+        if (format == "json") fprintf(out, "\n  ]\n}\n");
+        if (out != stdout) fclose(out);
+        return EXIT_SUCCESS;
+}
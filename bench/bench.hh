@@ -0,0 +1,157 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _BENCH_HH
+#define _BENCH_HH
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <boost/cstdint.hpp>
+
+/**
+ * A minimal microbenchmark harness, modeled on google-benchmark. Benchmarks
+ * are functions that take a bench::state and do the operation being measured
+ * once per pass through a keep_running() loop:
+ *
+ *   void ringbuffer_push(bench::state & s) {
+ *           ... setup ...
+ *           while (s.keep_running()) { ... }
+ *           s.set_bytes_processed(s.iterations() * nbytes);
+ *   }
+ *   BENCHMARK(ringbuffer_push)->arg(64)->arg(1024);
+ *
+ * The runner picks the number of iterations so that each benchmark runs for
+ * at least the minimum time, and reports nanoseconds per iteration.
+ */
+namespace bench {
+
+class state {
+public:
+        state(boost::uint64_t iterations, std::vector<long> const & args);
+
+        /** Returns true until the requested number of iterations has run */
+        bool keep_running() {
+                if (_remaining == _iterations) start();
+                if (_remaining == 0) {
+                        stop();
+                        return false;
+                }
+                --_remaining;
+                return true;
+        }
+
+        /** The ith argument of this run */
+        long range(std::size_t i) const { return _args.at(i); }
+
+        boost::uint64_t iterations() const { return _iterations; }
+
+        /**
+         * Exclude the time until resume_timing() from the measurement. The
+         * timer is already stopped once keep_running() returns false.
+         */
+        void pause_timing() { stop(); }
+        void resume_timing() { start(); }
+
+        void set_bytes_processed(boost::uint64_t n) { _bytes = n; }
+        void set_items_processed(boost::uint64_t n) { _items = n; }
+        void set_label(std::string const & label) { _label = label; }
+
+        /** Skip the benchmark (e.g. if a resource is unavailable). Return after calling */
+        void skip(std::string const & reason) { _error = reason; }
+
+        double elapsed_ns() const { return _elapsed; }
+        boost::uint64_t bytes_processed() const { return _bytes; }
+        boost::uint64_t items_processed() const { return _items; }
+        std::string const & label() const { return _label; }
+        std::string const & error() const { return _error; }
+
+private:
+        void start() {
+                clock_gettime(CLOCK_MONOTONIC, &_start);
+                _running = true;
+        }
+        void stop() {
+                if (!_running) return;
+                _running = false;
+                timespec t;
+                clock_gettime(CLOCK_MONOTONIC, &t);
+                _elapsed += (t.tv_sec - _start.tv_sec) * 1e9 + (t.tv_nsec - _start.tv_nsec);
+        }
+
+        boost::uint64_t const _iterations;
+        boost::uint64_t _remaining;
+        std::vector<long> _args;
+        timespec _start;
+        bool _running;
+        double _elapsed;
+        boost::uint64_t _bytes;
+        boost::uint64_t _items;
+        std::string _label;
+        std::string _error;
+};
+
+typedef void (*function_type)(state &);
+
+/** A registered benchmark and the argument sets to run it with */
+class benchmark {
+public:
+        benchmark(std::string const & name, function_type fn) : _name(name), _fn(fn) {}
+
+        /** Add a run with one argument */
+        benchmark * arg(long a) {
+                _args.push_back(std::vector<long>(1, a));
+                return this;
+        }
+
+        /** Add a run with two arguments */
+        benchmark * args(long a, long b) {
+                std::vector<long> v(1, a);
+                v.push_back(b);
+                _args.push_back(v);
+                return this;
+        }
+
+        /** Add runs for all combinations of two sets of arguments */
+        benchmark * ranges(std::vector<long> const & a, std::vector<long> const & b) {
+                for (std::size_t i = 0; i < a.size(); ++i)
+                        for (std::size_t j = 0; j < b.size(); ++j)
+                                args(a[i], b[j]);
+                return this;
+        }
+
+        std::string const & name() const { return _name; }
+        function_type function() const { return _fn; }
+        std::vector<std::vector<long> > const & argsets() const { return _args; }
+
+private:
+        std::string _name;
+        function_type _fn;
+        std::vector<std::vector<long> > _args;
+};
+
+/** Register a benchmark. The registry owns the returned object */
+benchmark * add(std::string const & name, function_type fn);
+
+/** Prevent the compiler from optimizing away a value */
+template <typename T>
+inline void do_not_optimize(T const & value) {
+        asm volatile("" : : "g"(value) : "memory");
+}
+
+} // namespace bench
+
+#define BENCHMARK_CAT_(a, b) a ## b
+#define BENCHMARK_CAT(a, b) BENCHMARK_CAT_(a, b)
+#define BENCHMARK(fn) \
+        static bench::benchmark * BENCHMARK_CAT(_benchmark_, __LINE__) \
+                __attribute__((unused)) = bench::add(#fn, fn)
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <cstdlib>
+#include <vector>
+#include <boost/assign/list_of.hpp>
+
+#include "jill/types.hh"
+#include "jill/dsp/crossing_counter.hh"
+#include "jill/dsp/threshold_gate.hh"
+#include "jill/digital_filter.hh"
+#include "bench.hh"
+
+using namespace jill;
+using std::vector;
+using boost::assign::list_of;
+
+namespace {
+
+vector<sample_t>
+noise(std::size_t n)
+{
+        unsigned short seed[3] = { 1, 2, 3 };
+        vector<sample_t> out(n);
+        for (std::size_t i = 0; i < n; ++i)
+                out[i] = erand48(seed) * 2.0 - 1.0;
+        return out;
+}
+
+}
+
+/* count threshold crossings in one period of noise. arg: period size */
+void
+crossing_counter_push(bench::state & s)
+{
+        std::size_t const nframes = s.range(0);
+        vector<sample_t> x = noise(nframes);
+        dsp::crossing_counter<sample_t> counter(0.5, 32, 100);
+        while (s.keep_running())
+                bench::do_not_optimize(counter.push(&x[0], nframes, 50));
+        s.set_items_processed(s.iterations() * nframes);
+}
+BENCHMARK(crossing_counter_push)->arg(64)->arg(256)->arg(1024)->arg(4096);
+
+/* filter one period of noise with a band-pass filter. args: order, period size */
+void
+digital_filter_filter_buf(bench::state & s)
+{
+        int const order = s.range(0);
+        std::size_t const nframes = s.range(1);
+        vector<sample_t> x = noise(nframes), y(nframes);
+        digital_filter filter;
+        filter.butter(order, list_of(500.0)(8000.0), "band-pass", 44100);
+        while (s.keep_running())
+                filter.filter_buf(&x[0], &y[0], "in", nframes);
+        bench::do_not_optimize(y[0]);
+        s.set_items_processed(s.iterations() * nframes);
+}
+BENCHMARK(digital_filter_filter_buf)->ranges(list_of(1)(2)(4)(8), list_of(64)(256)(1024));
+
+/*
+ * gate one period of noise. args: 0 for a plain gate, 1 with hysteresis and
+ * ramps; period size
+ */
+void
+threshold_gate_process(bench::state & s)
+{
+        bool const stateful = s.range(0);
+        std::size_t const nframes = s.range(1);
+        vector<sample_t> x = noise(nframes), y(nframes);
+        dsp::threshold_gate gate(dsp::threshold_gate::ABS, 0.5, stateful ? 0.2 : 0,
+                                 stateful ? 48 : 0, stateful ? 480 : 0);
+        dsp::threshold_gate::state state = dsp::threshold_gate::initial_state();
+        while (s.keep_running())
+                gate.process(state, &x[0], &y[0], nframes);
+        bench::do_not_optimize(y[0]);
+        s.set_items_processed(s.iterations() * nframes);
+}
+BENCHMARK(threshold_gate_process)->ranges(list_of(0)(1), list_of(64)(256)(1024));
@@ -0,0 +1,120 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <sndfile.h>
+#include <boost/filesystem.hpp>
+
+#include "jill/types.hh"
+#include "jill/file/arf_writer.hh"
+#include "jill/file/stimfile.hh"
+#include "test/harness.hh"
+#include "bench.hh"
+
+using namespace jill;
+using std::string;
+using std::vector;
+namespace fs = boost::filesystem;
+
+namespace {
+
+nframes_t const samplerate = 44100;
+
+/* a tone with some noise, so that compression has something to do */
+vector<sample_t>
+tone(std::size_t n)
+{
+        unsigned short seed[3] = { 1, 2, 3 };
+        vector<sample_t> out(n);
+        for (std::size_t i = 0; i < n; ++i)
+                out[i] = 0.5 * sin(2 * M_PI * 1000 * i / samplerate) + 0.01 * erand48(seed);
+        return out;
+}
+
+fs::path
+temp_path(char const * ext)
+{
+        return fs::temp_directory_path() / fs::unique_path(string("jill_bench_%%%%%%%%") + ext);
+}
+
+}
+
+/*
+ * Write periods of samples for one channel to an entry. args: compression
+ * level, period size
+ */
+void
+arf_writer_write(bench::state & s)
+{
+        int const compression = s.range(0);
+        std::size_t const nframes = s.range(1);
+        fs::path path = temp_path(".arf");
+        test::fixed_source source("jill_bench", samplerate);
+        std::map<string, string> attrs;
+
+        // a block with the id pcm_000, followed by the samples
+        vector<sample_t> x = tone(nframes);
+        std::size_t const nbytes = nframes * sizeof(sample_t);
+        vector<char> buf(sizeof(data_block_t) + 7 + nbytes);
+        data_block_t * block = reinterpret_cast<data_block_t*>(&buf[0]);
+        block->time = 0;
+        block->dtype = SAMPLED;
+        block->sz_id = 7;
+        block->sz_data = nbytes;
+        memcpy(&buf[sizeof(data_block_t)], "pcm_000", 7);
+        memcpy(&buf[sizeof(data_block_t) + 7], &x[0], nbytes);
+        {
+                file::arf_writer writer(path.string(), source, attrs, compression);
+                writer.new_entry(0);
+                while (s.keep_running()) {
+                        writer.write(block, 0, 0);
+                        block->time += nframes;
+                }
+                writer.close_entry();
+        }
+        fs::remove(path);
+        s.set_bytes_processed(s.iterations() * nbytes);
+}
+BENCHMARK(arf_writer_write)->args(0, 64)->args(0, 1024)->args(0, 4096)->args(1, 1024)
+        ->args(6, 1024);
+
+/* Load a 5 s stimulus, resampling if the argument is nonzero */
+void
+stimfile_load(bench::state & s)
+{
+        nframes_t const rate = s.range(0);
+        nframes_t const nframes = samplerate * 5;
+        fs::path path = temp_path(".wav");
+        SF_INFO info;
+        info.samplerate = samplerate;
+        info.channels = 1;
+        info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+        SNDFILE * sf = sf_open(path.string().c_str(), SFM_WRITE, &info);
+        if (sf == 0) {
+                s.skip(sf_strerror(0));
+                return;
+        }
+        vector<sample_t> x = tone(nframes);
+        sf_writef_float(sf, &x[0], nframes);
+        sf_close(sf);
+
+        while (s.keep_running()) {
+                file::stimfile f(path.string());
+                f.load_samples(rate);
+                bench::do_not_optimize(f.buffer());
+        }
+        fs::remove(path);
+        s.set_items_processed(s.iterations() * nframes);
+}
+BENCHMARK(stimfile_load)->arg(0)->arg(48000)->arg(96000);
@@ -0,0 +1,72 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "jill/types.hh"
+#include "jill/dsp/ringbuffer.hh"
+#include "jill/dsp/block_ringbuffer.hh"
+#include "bench.hh"
+
+using namespace jill;
+using std::vector;
+
+/* push and pop one period of samples. arg: period size */
+void
+ringbuffer_push_pop(bench::state & s)
+{
+        std::size_t const nframes = s.range(0);
+        dsp::ringbuffer<sample_t> rb(nframes * 16);
+        vector<sample_t> in(nframes, 0.5f), out(nframes);
+        while (s.keep_running()) {
+                rb.push(&in[0], nframes);
+                rb.pop(&out[0], nframes);
+        }
+        bench::do_not_optimize(out[0]);
+        s.set_bytes_processed(s.iterations() * nframes * sizeof(sample_t) * 2);
+}
+BENCHMARK(ringbuffer_push_pop)->arg(64)->arg(256)->arg(1024)->arg(4096);
+
+/*
+ * The cycle of the disk thread: the process thread pushes a block per
+ * channel, and the writer reads them with peek_ahead and releases them. args:
+ * number of channels, period size
+ */
+void
+block_ringbuffer_cycle(bench::state & s)
+{
+        std::size_t const nchannels = s.range(0);
+        std::size_t const nframes = s.range(1);
+        std::size_t const period_bytes = nframes * sizeof(sample_t);
+        dsp::block_ringbuffer rb(nchannels * (period_bytes + 64) * 8);
+        vector<sample_t> data(nframes, 0.5f);
+        vector<std::string> ids(nchannels);
+        char buf[32];
+        for (std::size_t c = 0; c < nchannels; ++c) {
+                snprintf(buf, sizeof(buf), "pcm_%03zu", c);
+                ids[c] = buf;
+        }
+        nframes_t time = 0;
+        while (s.keep_running()) {
+                for (std::size_t c = 0; c < nchannels; ++c)
+                        rb.push(time, SAMPLED, ids[c].c_str(), period_bytes, &data[0]);
+                for (std::size_t c = 0; c < nchannels; ++c)
+                        bench::do_not_optimize(rb.peek_ahead());
+                for (std::size_t c = 0; c < nchannels; ++c)
+                        rb.release();
+                time += nframes;
+        }
+        s.set_bytes_processed(s.iterations() * nchannels * period_bytes);
+        s.set_items_processed(s.iterations() * nchannels);
+}
+BENCHMARK(block_ringbuffer_cycle)->args(1, 64)->args(1, 1024)->args(8, 64)->args(8, 1024)
+        ->args(32, 256);
@@ -69,6 +69,16 @@ block_ringbuffer::peek() const
 }
 
 
+data_block_t const *
+block_ringbuffer::block_at(size_t position) const
+{
+        size_t offset = position - read_position();
+        if (offset >= read_space()) return 0;
+        // the buffer is mirrored, so this is contiguous
+        return reinterpret_cast<data_block_t const *>(buffer() + read_offset() + offset);
+}
+
+
 void
 block_ringbuffer::release()
 {
@@ -86,3 +96,12 @@ block_ringbuffer::release_all()
         super::pop(0,0);
         _read_ahead_ptr = 0;
 }
+
+void
+block_ringbuffer::release_to(size_t position)
+{
+        size_t bytes = position - read_position();
+        if (bytes == 0 || bytes > read_space()) return;
+        _read_ahead_ptr = (_read_ahead_ptr > bytes) ? _read_ahead_ptr - bytes : 0;
+        super::pop(0, bytes);
+}
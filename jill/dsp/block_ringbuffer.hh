@@ -103,6 +103,18 @@ public:
          */
         data_block_t const * peek() const;
 
+        /**
+         * Read access to a block anywhere in the read queue, without changing
+         * the read or read-ahead pointers.
+         *
+         * @param position  the absolute position of the block (see
+         *                  ringbuffer::read_position()). Must be on a block
+         *                  boundary.
+         * @return data_block_t* for the block, or 0 if position is not in the
+         *         read queue
+         */
+        data_block_t const * block_at(std::size_t position) const;
+
         /**
          * Release the oldest block in the read queue, making the memory
          * available to the write thread and advancing the read pointer
@@ -112,6 +124,13 @@ public:
         /** Release all data in the read queue */
         void release_all();
 
+        /**
+         * Release all the blocks before an absolute position in the buffer (see
+         * ringbuffer::read_position()). The position must be on a block
+         * boundary, and must not be past the read-ahead pointer.
+         */
+        void release_to(std::size_t position);
+
 private:
         std::size_t _read_ahead_ptr; // the number of bytes ahead of the _read_ptr
 
@@ -11,12 +11,16 @@
  */
 #include <iostream>
 #include <vector>
+#include <time.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/type_traits/make_signed.hpp>
 #include <boost/filesystem.hpp>
 
 #include "../logging.hh"
 #include "../zmq.hh"
+#include "../util/thread_policy.hh"
 #include "buffered_data_writer.hh"
 #include "block_ringbuffer.hh"
 
@@ -25,6 +29,19 @@ using namespace jill::dsp;
 using std::size_t;
 using std::string;
 
+/** A data type for comparing differences between frame counts */
+typedef boost::make_signed<nframes_t>::type framediff_t;
+
+/*
+ * The period index can't have more entries than there are blocks in the data
+ * buffer, and a block is always larger than its header.
+ */
+static size_t
+period_index_size(size_t buffer_bytes)
+{
+        return std::max<size_t>(buffer_bytes / sizeof(data_block_t), 64);
+}
+
 /*
  * # Notes on buffered data_thread objects
  *
@@ -32,6 +49,9 @@ using std::string;
  * ringbuffer. The consumer thread pulls data off the ringbuffer and passes it
  * to the data_writer object. If there's no data in the ringbuffer, the consumer
  * writes any queued log messages and requests the writer to flush data to disk.
+ * Log messages are only read for log_budget_usec per pass, and the consumer
+ * goes back to the data as soon as any arrives, so a flood of messages can't
+ * cause the ringbuffer to overrun.
  * It then waits for a condition variable that's flagged when the consumer calls
  * push().
  *
@@ -47,6 +67,8 @@ buffered_data_writer::buffered_data_writer(boost::shared_ptr<data_writer> writer
         : _state(Stopped),
           _writer(writer),
           _buffer(new block_ringbuffer(buffer_size)),
+          _periods(new ringbuffer<period_mark_t>(period_index_size(buffer_size))),
+          _period_open(false), _period_start(0), _period_stop(0),
           _context(zmq_init(1)), _socket(zmq_socket(_context, ZMQ_DEALER)),
           _logger_bound(false)
 {
@@ -76,12 +98,31 @@ buffered_data_writer::push(nframes_t time, dtype_t dtype, char const * id,
                 if (_buffer->push(time, dtype, id, size, data) == 0) {
                         xrun();
                 }
+                // track the extent of the current period
+                nframes_t stop = time + ((dtype == SAMPLED) ? size / sizeof(sample_t) : 1);
+                if (!_period_open) {
+                        _period_start = time;
+                        _period_stop = stop;
+                        _period_open = true;
+                }
+                else {
+                        if ((framediff_t)(time - _period_start) < 0) _period_start = time;
+                        if ((framediff_t)(stop - _period_stop) > 0) _period_stop = stop;
+                }
         }
 }
 
 void
 buffered_data_writer::data_ready()
 {
+        if (_period_open) {
+                period_mark_t mark = { _period_start, _period_stop - _period_start,
+                                       _buffer->write_position() };
+                if (_periods->push(mark) == 0) {
+                        xrun();
+                }
+                _period_open = false;
+        }
         if (pthread_mutex_trylock (&_lock) == 0) {
                 pthread_cond_signal (&_ready);
                 pthread_mutex_unlock (&_lock);
@@ -138,7 +179,11 @@ buffered_data_writer::request_buffer_size(size_t bytes)
         // block until the buffer is empty
         pthread_mutex_lock(&_lock);
         if (bytes > _buffer->size()) {
+                // any data held for a pretrigger are discarded
+                _buffer->release_all();
                 _buffer->resize(bytes);
+                _periods->pop(0);
+                _periods->resize(period_index_size(_buffer->size()));
         }
         pthread_mutex_unlock(&_lock);
         return _buffer->size();
@@ -148,6 +193,7 @@ void *
 buffered_data_writer::thread(void * arg)
 {
         buffered_data_writer * self = static_cast<buffered_data_writer *>(arg);
+        util::thread_policy::apply("writer");
         data_block_t const * hdr;
 
 	pthread_setcanceltype (PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
@@ -158,7 +204,7 @@ buffered_data_writer::thread(void * arg)
 
         while (1) {
                 if (__sync_bool_compare_and_swap(&self->_xrun, true, false)) {
-                        self->_writer->xrun();
+                        self->mark_xrun();
                 }
                 hdr = self->_buffer->peek_ahead();
                 if (hdr == 0) {
@@ -169,7 +215,7 @@ buffered_data_writer::thread(void * arg)
                         }
                         /* otherwise flush to disk and wait for more data */
                         else {
-                                self->_writer->flush();
+                                self->flush_writers();
                                 pthread_cond_wait (&self->_ready, &self->_lock);
                         }
                 }
@@ -177,7 +223,7 @@ buffered_data_writer::thread(void * arg)
                         self->write(hdr);
                 }
         }
-        self->_writer->close_entry();
+        self->close_entries();
         pthread_mutex_unlock(&self->_lock);
         self->_state = Stopped;
         INFO << "exited writer thread";
@@ -193,6 +239,37 @@ buffered_data_writer::write(data_block_t const * data)
         }
         _writer->write(data, 0, 0);
         _buffer->release();
+        first_period();         // drops index entries for released periods
+}
+
+void
+buffered_data_writer::mark_xrun()
+{
+        _writer->xrun();
+}
+
+void
+buffered_data_writer::flush_writers()
+{
+        _writer->flush();
+}
+
+void
+buffered_data_writer::close_entries()
+{
+        _writer->close_entry();
+}
+
+period_mark_t const *
+buffered_data_writer::first_period()
+{
+        while (_periods->read_space() > 0) {
+                period_mark_t const * mark = _periods->buffer() + _periods->read_offset();
+                if (mark->end > _buffer->read_position())
+                        return mark;
+                _periods->pop(0, 1);
+        }
+        return 0;
 }
 
 void
@@ -200,18 +277,42 @@ buffered_data_writer::write_messages()
 {
         using namespace boost::posix_time;
 
-        // only record a limited number of messages on any given pass, in case
-        // there's a huge backlog in the queue
-        static const int max_messages = 100;
+        // only spend a limited amount of time on any given pass, in case
+        // there's a huge backlog in the queue, and yield as soon as there's
+        // data in the ringbuffer
         if (!_logger_bound) return;
-        for (int i = 0; i < max_messages; ++i) {
-                // expect a three-part message: source, timestamp, message
+        timespec now, deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += log_budget_usec * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+        }
+        for (;;) {
+                if (!_buffer->empty_ahead()) return;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (now.tv_sec > deadline.tv_sec ||
+                    (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+                        return;
+
+                zmq::msg_ptr_t message = zmq::msg_init();
+                int rc = zmq_msg_recv (message.get(), _socket, ZMQ_DONTWAIT);
+                if (rc == -1) return;
+
+                // batched binary messages
+                if (zmq::log_batch_parse(message,
+                                         boost::bind(&buffered_data_writer::log_batch_record,
+                                                     this, _1, _2, _3, _4)) >= 0)
+                        continue;
+
+                // otherwise expect a three-part message: source, timestamp, message
                 int64_t more = 1;
                 size_t more_size = sizeof(more);
-                std::vector<zmq::msg_ptr_t> messages;
+                std::vector<zmq::msg_ptr_t> messages(1, message);
+                zmq_getsockopt (_socket, ZMQ_RCVMORE, &more, &more_size);
                 while (more) {
-                        zmq::msg_ptr_t message = zmq::msg_init();
-                        int rc = zmq_msg_recv (message.get(), _socket, ZMQ_DONTWAIT);
+                        message = zmq::msg_init();
+                        rc = zmq_msg_recv (message.get(), _socket, ZMQ_DONTWAIT);
                         if (rc == -1) return;
                         messages.push_back(message);
                         zmq_getsockopt (_socket, ZMQ_RCVMORE, &more, &more_size);
@@ -224,6 +325,15 @@ buffered_data_writer::write_messages()
         }
 }
 
+void
+buffered_data_writer::log_batch_record(string const & source, boost::int64_t usec,
+                                       char const * msg, size_t size)
+{
+        using namespace boost::posix_time;
+        static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+        _writer->log(epoch + microseconds(usec), source, string(msg, size));
+}
+
 void
 buffered_data_writer::bind_logger(std::string const & server_name)
 {
@@ -15,8 +15,10 @@
 #include <iosfwd>
 #include <pthread.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
 #include "../data_thread.hh"
 #include "../data_writer.hh"
+#include "ringbuffer.hh"
 
 namespace jill {
 
@@ -24,12 +26,27 @@ namespace dsp {
 
 class block_ringbuffer;
 
+/**
+ * Entry in the period index of buffered_data_writer. Each entry marks the end
+ * of one period's worth of blocks in the data ringbuffer.
+ */
+struct period_mark_t {
+        nframes_t time;         // the earliest time of any block in the period
+        nframes_t nframes;      // the duration of the period
+        std::size_t end;        // the position of the end of the period (see
+                                // ringbuffer::write_position())
+};
+
 /**
  * An implementation of the data thread that uses a ringbuffer to move data
  * between the push() function and a writer thread.  The logic for actually
  * storing the data (and log messages) is provided through an owned data_writer.
  * This implementation records continuously, though other threads may call
  * reset() to split data into separate entries.
+ *
+ * Each call to data_ready() marks the end of a period. The positions of the
+ * period boundaries are stored in a second ringbuffer, so that deriving classes
+ * can skip or release whole periods at once without walking the blocks.
  */
 class buffered_data_writer : public data_thread {
 
@@ -91,22 +108,49 @@ protected:
 
         /**
          * Collect log messages from the zmq socket and write them. Call this
-         * when load is low.
+         * when load is low. Returns when the socket is empty, when data are
+         * available in the ringbuffer, or after log_budget_usec.
          */
         void write_messages();
 
+        /** The maximum time to spend collecting log messages on each pass (us) */
+        static const long log_budget_usec = 2000;
+
+        /** Called by the writer thread when an xrun has occurred */
+        virtual void mark_xrun();
+
+        /** Called by the writer thread when the ringbuffer is empty */
+        virtual void flush_writers();
+
+        /** Called by the writer thread before it exits */
+        virtual void close_entries();
+
+        /**
+         * The oldest complete period in the ringbuffer, or 0 if the index is
+         * empty. Index entries for periods that have already been released are
+         * discarded. Only call from the writer thread.
+         */
+        period_mark_t const * first_period();
+
         state_t _state;                            // thread state
         bool _reset;                               // flag to reset stream
 
         boost::shared_ptr<data_writer> _writer;            // output
         boost::shared_ptr<block_ringbuffer> _buffer;      // ringbuffer
+        boost::shared_ptr<ringbuffer<period_mark_t> > _periods;  // period index
 
 private:
         pthread_mutex_t _lock;                     // mutex for condition variable
         pthread_cond_t  _ready;                    // indicates data ready
         static void * thread(void * arg);           // the thread entry point
+        void log_batch_record(std::string const & source, boost::int64_t usec,
+                              char const * msg, std::size_t size);
         pthread_t _thread_id;                      // thread id
         bool _xrun;                                // flag to indicate xrun
+        // producer state for the period index
+        bool _period_open;
+        nframes_t _period_start;
+        nframes_t _period_stop;
         // variables for receiving incoming messages
         void * _context;
         void * _socket;
@@ -0,0 +1,139 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdexcept>
+#include "chunk_encoder.hh"
+#include "rice_codec.hh"
+#include "../util/thread_policy.hh"
+
+using namespace jill::dsp;
+
+chunk_encoder::chunk_encoder(std::size_t nthreads)
+        : _next_job(0), _stopping(false)
+{
+        pthread_mutex_init(&_lock, 0);
+        pthread_cond_init(&_work, 0);
+        pthread_cond_init(&_done, 0);
+        if (nthreads < 1) nthreads = 1;
+        for (std::size_t i = 0; i < nthreads; ++i) {
+                pthread_t t;
+                if (pthread_create(&t, 0, thread, this) != 0) break;
+                _threads.push_back(t);
+        }
+        if (_threads.empty()) {
+                throw std::runtime_error("unable to start encoder threads");
+        }
+}
+
+chunk_encoder::~chunk_encoder()
+{
+        pthread_mutex_lock(&_lock);
+        _stopping = true;
+        pthread_cond_broadcast(&_work);
+        pthread_mutex_unlock(&_lock);
+        for (std::vector<pthread_t>::iterator it = _threads.begin(); it != _threads.end(); ++it) {
+                pthread_join(*it, 0);
+        }
+        for (std::deque<job>::iterator it = _queue.begin(); it != _queue.end(); ++it) {
+                delete it->c;
+        }
+        for (std::vector<chunk *>::iterator it = _free.begin(); it != _free.end(); ++it) {
+                delete *it;
+        }
+        pthread_cond_destroy(&_done);
+        pthread_cond_destroy(&_work);
+        pthread_mutex_destroy(&_lock);
+}
+
+chunk_encoder::chunk *
+chunk_encoder::acquire()
+{
+        if (_free.empty()) return new chunk;
+        chunk * c = _free.back();
+        _free.pop_back();
+        return c;
+}
+
+void
+chunk_encoder::submit(chunk * c)
+{
+        job j = { c, false };
+        pthread_mutex_lock(&_lock);
+        _queue.push_back(j);
+        pthread_cond_signal(&_work);
+        pthread_mutex_unlock(&_lock);
+}
+
+chunk_encoder::chunk *
+chunk_encoder::next(bool wait)
+{
+        chunk * c = 0;
+        pthread_mutex_lock(&_lock);
+        while (!_queue.empty()) {
+                if (_queue.front().done) {
+                        c = _queue.front().c;
+                        _queue.pop_front();
+                        _next_job -= 1;
+                        break;
+                }
+                if (!wait) break;
+                pthread_cond_wait(&_done, &_lock);
+        }
+        pthread_mutex_unlock(&_lock);
+        return c;
+}
+
+void
+chunk_encoder::release(chunk * c)
+{
+        c->samples.clear();
+        c->data.clear();
+        _free.push_back(c);
+}
+
+void *
+chunk_encoder::thread(void * arg)
+{
+        chunk_encoder * self = static_cast<chunk_encoder*>(arg);
+        jill::util::thread_policy::apply("encoder");
+        pthread_mutex_lock(&self->_lock);
+        while (1) {
+                if (self->_next_job < self->_queue.size()) {
+                        // jobs aren't removed from the queue until they're
+                        // collected, so the index is stable while we work
+                        std::size_t idx = self->_next_job++;
+                        chunk * c = self->_queue[idx].c;
+                        pthread_mutex_unlock(&self->_lock);
+
+                        c->data.clear();
+                        if (!c->samples.empty())
+                                rice_codec::encode(&c->samples[0], c->samples.size(), c->data);
+
+                        pthread_mutex_lock(&self->_lock);
+                        // the owner may have collected earlier jobs meanwhile
+                        for (std::deque<job>::iterator it = self->_queue.begin();
+                             it != self->_queue.end(); ++it) {
+                                if (it->c == c) {
+                                        it->done = true;
+                                        break;
+                                }
+                        }
+                        pthread_cond_signal(&self->_done);
+                }
+                else if (self->_stopping) {
+                        break;
+                }
+                else {
+                        pthread_cond_wait(&self->_work, &self->_lock);
+                }
+        }
+        pthread_mutex_unlock(&self->_lock);
+        return 0;
+}
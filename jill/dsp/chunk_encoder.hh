@@ -0,0 +1,98 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _CHUNK_ENCODER_HH
+#define _CHUNK_ENCODER_HH
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup buffergroup
+ * @brief encodes chunks of samples on a pool of threads
+ *
+ * The owner fills a chunk (obtained from acquire()) with integer samples and
+ * submits it. Worker threads compress the chunks with rice_codec, and the owner
+ * collects them with next() in the order they were submitted, so a stream can
+ * be written out in sequence while several chunks are being encoded. Finished
+ * chunks should be returned with release() so their buffers can be reused.
+ *
+ * acquire(), submit(), next(), and release() must be called from a single
+ * thread.
+ */
+class chunk_encoder : boost::noncopyable {
+public:
+        struct chunk {
+                std::string channel;                    // channel id
+                std::vector<boost::int32_t> samples;    // input samples
+                std::vector<char> data;                 // encoded chunk
+        };
+
+        /**
+         * Start the worker threads.
+         *
+         * @param nthreads   the number of threads to encode with (at least 1)
+         */
+        explicit chunk_encoder(std::size_t nthreads);
+
+        /** Stop the worker threads. Any chunks not collected are discarded. */
+        ~chunk_encoder();
+
+        /** Get an empty chunk to fill */
+        chunk * acquire();
+
+        /** Queue a chunk for encoding. The encoder takes ownership. */
+        void submit(chunk *);
+
+        /**
+         * Get the oldest submitted chunk if it's been encoded.
+         *
+         * @param wait  if true, wait for the chunk to be encoded
+         * @return the chunk, or 0 if none are queued or (if wait is false) the
+         *         oldest chunk isn't finished.
+         */
+        chunk * next(bool wait);
+
+        /** Return a chunk obtained from next() */
+        void release(chunk *);
+
+        /** The number of chunks submitted but not collected */
+        std::size_t pending() const { return _queue.size(); }
+
+        /** The number of worker threads */
+        std::size_t nthreads() const { return _threads.size(); }
+
+private:
+        struct job {
+                chunk * c;
+                bool done;
+        };
+
+        static void * thread(void * arg);
+
+        std::deque<job> _queue;                 // submitted chunks, in order
+        std::size_t _next_job;                  // first job not yet taken by a worker
+        std::vector<chunk *> _free;             // chunks available for reuse
+        std::vector<pthread_t> _threads;
+        pthread_mutex_t _lock;
+        pthread_cond_t _work;                   // signals workers that jobs are queued
+        pthread_cond_t _done;                   // signals owner that a job is finished
+        bool _stopping;
+};
+
+}} // namespace jill::dsp
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _OVERVIEW_HH
+#define _OVERVIEW_HH
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/** summary of the samples in one bin of an overview */
+struct overview_record {
+        float min;
+        float max;
+        float rms;
+};
+
+/**
+ * @ingroup miscgroup
+ * @brief multi-resolution min/max/RMS summary of a signal
+ *
+ * Maintains a pyramid of overviews of a signal. Each bin of level 0 summarizes
+ * base_frames samples, and each bin of level L+1 summarizes factor bins of
+ * level L. The summaries are computed incrementally as samples are pushed, and
+ * finished bins are appended to records(L) for the caller to store (and clear).
+ */
+class overview_pyramid {
+public:
+        /**
+         * @param base_frames  the number of samples in each level 0 bin
+         * @param factor       the number of bins combined at each higher level
+         * @param nlevels      the number of levels
+         */
+        overview_pyramid(std::size_t base_frames, std::size_t factor, std::size_t nlevels)
+                : _levels(nlevels), _records(nlevels) {
+                std::size_t size = std::max<std::size_t>(base_frames, 1);
+                for (std::size_t i = 0; i < nlevels; ++i) {
+                        _levels[i].size = size;
+                        _levels[i].clear();
+                        size *= std::max<std::size_t>(factor, 2);
+                }
+        }
+
+        std::size_t nlevels() const { return _levels.size(); }
+
+        /** The number of samples summarized by each bin in a level */
+        std::size_t bin_size(std::size_t level) const { return _levels[level].size; }
+
+        /** Finished bins for a level, oldest first */
+        std::vector<overview_record> & records(std::size_t level) { return _records[level]; }
+
+        /** Add samples to the overview */
+        void push(sample_t const * samples, std::size_t n) {
+                if (_levels.empty()) return;
+                bin & b = _levels[0];
+                while (n > 0) {
+                        std::size_t count = std::min(n, b.size - b.count);
+                        reduce(samples, count, b);
+                        b.count += count;
+                        samples += count;
+                        n -= count;
+                        if (b.count == b.size) emit(0);
+                }
+        }
+
+        /** Finish any partially filled bins, e.g. at the end of a recording */
+        void finish() {
+                for (std::size_t i = 0; i < _levels.size(); ++i) {
+                        if (_levels[i].count > 0) emit(i);
+                }
+        }
+
+private:
+        struct bin {
+                std::size_t size;
+                std::size_t count;
+                float min;
+                float max;
+                double sumsq;
+                void clear() {
+                        count = 0;
+                        min = HUGE_VALF;
+                        max = -HUGE_VALF;
+                        sumsq = 0;
+                }
+        };
+
+        /*
+         * Update min, max, and sum of squares of a bin. Floating point
+         * reductions can't be reordered by the compiler, so the loop keeps
+         * separate accumulators for each of 'lanes' interleaved sequences,
+         * which it can vectorize.
+         */
+        static void reduce(sample_t const * x, std::size_t n, bin & b) {
+                enum { lanes = 8 };
+                float lo[lanes], hi[lanes], ss[lanes];
+                for (int j = 0; j < lanes; ++j) {
+                        lo[j] = b.min;
+                        hi[j] = b.max;
+                        ss[j] = 0.0f;
+                }
+                std::size_t i = 0;
+                for (; i + lanes <= n; i += lanes) {
+                        for (int j = 0; j < lanes; ++j) {
+                                float v = x[i + j];
+                                lo[j] = (v < lo[j]) ? v : lo[j];
+                                hi[j] = (v > hi[j]) ? v : hi[j];
+                                ss[j] += v * v;
+                        }
+                }
+                for (; i < n; ++i) {
+                        float v = x[i];
+                        lo[0] = (v < lo[0]) ? v : lo[0];
+                        hi[0] = (v > hi[0]) ? v : hi[0];
+                        ss[0] += v * v;
+                }
+                double sumsq = 0;
+                for (int j = 0; j < lanes; ++j) {
+                        b.min = std::min(b.min, lo[j]);
+                        b.max = std::max(b.max, hi[j]);
+                        sumsq += ss[j];
+                }
+                b.sumsq += sumsq;
+        }
+
+        /* output a bin, add it to the next level, and reset it */
+        void emit(std::size_t level) {
+                bin & b = _levels[level];
+                overview_record r = { b.min, b.max, float(std::sqrt(b.sumsq / b.count)) };
+                _records[level].push_back(r);
+                if (level + 1 < _levels.size()) {
+                        bin & next = _levels[level + 1];
+                        next.min = std::min(next.min, b.min);
+                        next.max = std::max(next.max, b.max);
+                        next.sumsq += b.sumsq;
+                        next.count += b.count;
+                        if (next.count == next.size) emit(level + 1);
+                }
+                b.clear();
+        }
+
+        std::vector<bin> _levels;
+        std::vector<std::vector<overview_record> > _records;
+};
+
+}} // namespace jill::dsp
+
+#endif
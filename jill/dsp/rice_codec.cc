@@ -0,0 +1,222 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <algorithm>
+#include <stdexcept>
+#include "rice_codec.hh"
+
+using namespace jill::dsp;
+using boost::int32_t;
+using boost::int64_t;
+using boost::uint32_t;
+using boost::uint64_t;
+
+/* unary codes this long are followed by a verbatim 32-bit residual */
+static const unsigned int escape_length = 32;
+/* Rice parameter indicating that all the residuals in a partition are zero */
+static const unsigned int zero_partition = 31;
+
+namespace {
+
+inline uint32_t
+zigzag(int32_t r)
+{
+        return (uint32_t(r) << 1) ^ uint32_t(r >> 31);
+}
+
+inline int32_t
+unzigzag(uint32_t z)
+{
+        return int32_t(z >> 1) ^ -int32_t(z & 1);
+}
+
+/* prediction from the previous samples using the fixed polynomial of order */
+inline int64_t
+predict(int32_t const * x, unsigned int order)
+{
+        switch (order) {
+        case 1: return x[-1];
+        case 2: return 2 * int64_t(x[-1]) - x[-2];
+        case 3: return 3 * (int64_t(x[-1]) - x[-2]) + x[-3];
+        case 4: return 4 * (int64_t(x[-1]) + x[-3]) - 6 * int64_t(x[-2]) - x[-4];
+        default: return 0;
+        }
+}
+
+/* writes bits MSB-first */
+class bit_writer {
+public:
+        bit_writer(std::vector<char> & out) : _out(out), _acc(0), _nbits(0) {}
+
+        void put(uint32_t value, unsigned int bits) {
+                _acc = (_acc << bits) | value;
+                _nbits += bits;
+                while (_nbits >= 8) {
+                        _nbits -= 8;
+                        _out.push_back(char(_acc >> _nbits));
+                }
+        }
+
+        void flush() {
+                if (_nbits > 0) put(0, 8 - _nbits);
+        }
+
+private:
+        std::vector<char> & _out;
+        uint64_t _acc;
+        unsigned int _nbits;
+};
+
+class bit_reader {
+public:
+        bit_reader(char const * data, std::size_t nbytes)
+                : _data(reinterpret_cast<unsigned char const *>(data)), _end(_data + nbytes),
+                  _acc(0), _nbits(0) {}
+
+        uint32_t get(unsigned int bits) {
+                while (_nbits < bits) {
+                        if (_data == _end) throw std::runtime_error("truncated chunk");
+                        _acc = (_acc << 8) | *_data++;
+                        _nbits += 8;
+                }
+                _nbits -= bits;
+                return uint32_t((_acc >> _nbits) & ((uint64_t(1) << bits) - 1));
+        }
+
+        /* count one bits up to a zero bit, or up to max */
+        unsigned int unary(unsigned int max) {
+                unsigned int q = 0;
+                while (q < max && get(1)) ++q;
+                return q;
+        }
+
+private:
+        unsigned char const * _data;
+        unsigned char const * _end;
+        uint64_t _acc;
+        unsigned int _nbits;
+};
+
+void
+put_le32(std::vector<char> & out, uint32_t v)
+{
+        for (int i = 0; i < 4; ++i) out.push_back(char(v >> (8 * i)));
+}
+
+uint32_t
+get_le32(unsigned char const * p)
+{
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+} // anonymous namespace
+
+
+std::size_t
+rice_codec::encode(int32_t const * x, std::size_t n, std::vector<char> & out)
+{
+        std::size_t const start = out.size();
+
+        /* choose the predictor with the smallest total residual */
+        uint64_t err[max_order + 1] = {0};
+        int32_t last[max_order] = {0};  // last[k]: previous difference of order k
+        for (std::size_t i = 0; i < n; ++i) {
+                int64_t d = x[i];
+                for (unsigned int k = 0; k <= max_order; ++k) {
+                        if (i >= max_order) err[k] += (d < 0) ? -d : d;
+                        if (k == max_order) break;
+                        int64_t next = d - last[k];
+                        last[k] = int32_t(d);
+                        d = next;
+                }
+        }
+        unsigned int order = 0;
+        for (unsigned int k = 1; k <= max_order && k < n; ++k) {
+                if (err[k] < err[order]) order = k;
+        }
+
+        put_le32(out, uint32_t(n));
+        out.push_back(char(order));
+        for (unsigned int i = 0; i < order; ++i) put_le32(out, uint32_t(x[i]));
+
+        /* residuals */
+        std::vector<uint32_t> res(n - order);
+        for (std::size_t i = order; i < n; ++i) {
+                res[i - order] = zigzag(int32_t(x[i] - predict(x + i, order)));
+        }
+
+        bit_writer bits(out);
+        for (std::size_t p = 0; p < res.size(); p += partition_size) {
+                std::size_t const cnt = std::min(partition_size, res.size() - p);
+                uint64_t sum = 0;
+                for (std::size_t i = p; i < p + cnt; ++i) sum += res[i];
+                if (sum == 0) {
+                        bits.put(zero_partition, 5);
+                        continue;
+                }
+                // parameter close to log2 of the mean
+                unsigned int k = 0;
+                while (k < 24 && (uint64_t(cnt) << (k + 1)) <= sum) ++k;
+                bits.put(k, 5);
+                for (std::size_t i = p; i < p + cnt; ++i) {
+                        uint32_t q = res[i] >> k;
+                        if (q < escape_length) {
+                                bits.put(((1U << q) - 1) << 1, q + 1);
+                                if (k) bits.put(res[i] & ((1U << k) - 1), k);
+                        }
+                        else {
+                                bits.put(0xffffffffU, escape_length);
+                                bits.put(res[i], 32);
+                        }
+                }
+        }
+        bits.flush();
+        return out.size() - start;
+}
+
+
+std::size_t
+rice_codec::decode(char const * data, std::size_t nbytes, std::vector<int32_t> & out)
+{
+        unsigned char const * p = reinterpret_cast<unsigned char const *>(data);
+        if (nbytes < 5) throw std::runtime_error("truncated chunk header");
+        std::size_t const n = get_le32(p);
+        unsigned int const order = p[4];
+        if (order > max_order || order > n || nbytes < 5 + 4 * order)
+                throw std::runtime_error("corrupt chunk header");
+
+        std::size_t const start = out.size();
+        out.resize(start + n);
+        int32_t * x = &out[start];
+        for (unsigned int i = 0; i < order; ++i) x[i] = int32_t(get_le32(p + 5 + 4 * i));
+
+        bit_reader bits(data + 5 + 4 * order, nbytes - 5 - 4 * order);
+        for (std::size_t i = order; i < n; ) {
+                std::size_t const cnt = std::min(partition_size, n - i);
+                unsigned int k = bits.get(5);
+                if (k == zero_partition) {
+                        for (std::size_t j = 0; j < cnt; ++j, ++i)
+                                x[i] = int32_t(predict(x + i, order));
+                        continue;
+                }
+                for (std::size_t j = 0; j < cnt; ++j, ++i) {
+                        uint32_t z;
+                        unsigned int q = bits.unary(escape_length);
+                        if (q < escape_length) {
+                                z = (uint32_t(q) << k) | (k ? bits.get(k) : 0);
+                        }
+                        else {
+                                z = bits.get(32);
+                        }
+                        x[i] = int32_t(unzigzag(z) + predict(x + i, order));
+                }
+        }
+        return n;
+}
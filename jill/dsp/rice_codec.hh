@@ -0,0 +1,76 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _RICE_CODEC_HH
+#define _RICE_CODEC_HH
+
+#include <cstddef>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup miscgroup
+ * @brief lossless compression for integer samples
+ *
+ * Encodes a chunk of integer samples (up to 24 bits) using the fixed
+ * polynomial predictors from FLAC. The predictor order (0-4) with the smallest
+ * residuals is chosen for each chunk, and the residuals are stored with Rice
+ * codes, with a separate parameter for each partition of rice_partition_size
+ * residuals. Residuals too large for the code are escaped and stored verbatim.
+ *
+ * Chunk layout (little-endian):
+ *
+ *     uint32  number of samples
+ *     uint8   predictor order
+ *     int32   the first [order] samples
+ *     bits    for each partition: 5-bit Rice parameter, then the coded residuals
+ *             (a parameter of 31 means the residuals are all zero, and none
+ *             are stored)
+ *
+ * Chunks are independent of each other, so they can be encoded in parallel and
+ * decoded without reading the rest of the stream.
+ */
+class rice_codec {
+public:
+        /** The number of residuals in each Rice partition */
+        static const std::size_t partition_size = 256;
+        /** The highest predictor order */
+        static const unsigned int max_order = 4;
+
+        /**
+         * Encode a chunk of samples.
+         *
+         * @param samples   the samples. Values must fit in 24 bits.
+         * @param nsamples  the number of samples
+         * @param out       output buffer. Encoded bytes are appended.
+         * @return the number of bytes appended to out
+         */
+        static std::size_t encode(boost::int32_t const * samples, std::size_t nsamples,
+                                  std::vector<char> & out);
+
+        /**
+         * Decode a chunk of samples.
+         *
+         * @param data   the encoded chunk
+         * @param nbytes the length of the encoded chunk
+         * @param out    output buffer. Decoded samples are appended.
+         * @return the number of samples decoded
+         * @throws std::runtime_error if the chunk is corrupt
+         */
+        static std::size_t decode(char const * data, std::size_t nbytes,
+                                  std::vector<boost::int32_t> & out);
+};
+
+}} // namespace jill::dsp
+
+#endif
@@ -166,6 +166,12 @@ public:
                 return cnt;
         }
 
+        /// @return the total number of elements written to the buffer
+        std::size_t write_position() const { return _write_ptr; }
+
+        /// @return the total number of elements read from the buffer
+        std::size_t read_position() const { return _read_ptr; }
+
         std::size_t write_offset() const {
                 return _write_ptr & _size_mask;
         };
@@ -0,0 +1,91 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _SAMPLE_CONVERT_HH
+#define _SAMPLE_CONVERT_HH
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup miscgroup
+ * @brief traits for integer sample formats
+ *
+ * full_scale is the integer value corresponding to a float sample of 1.0.
+ * 24-bit samples are stored in 32-bit integers.
+ */
+template <typename T, int Bits> struct int_sample_traits {
+        typedef T value_type;
+        static float full_scale() { return float(1L << (Bits - 1)); }
+        static float max() { return float((1L << (Bits - 1)) - 1); }
+        static float min() { return -float(1L << (Bits - 1)); }
+};
+
+typedef int_sample_traits<boost::int16_t, 16> int16_sample;
+typedef int_sample_traits<boost::int32_t, 24> int24_sample;
+
+/**
+ * @ingroup miscgroup
+ * @brief convert floating point samples to integers
+ *
+ * Samples are scaled so that 1.0 maps to Traits::full_scale(), optionally
+ * dithered with triangular (TPDF) noise of +/- 1 LSB, clipped to the range of
+ * the integer format, and rounded to the nearest integer. n should be less
+ * than 2^32.
+ *
+ * The dither noise comes from a hash of a running sample counter rather than a
+ * sequential generator, and clipping is counted rather than branched on, so
+ * the loop has no dependencies between samples and can be vectorized by the
+ * compiler.
+ *
+ * @param in       input samples
+ * @param out      output buffer, at least n samples long
+ * @param n        the number of samples to convert
+ * @param dither   if true, add TPDF dither before rounding
+ * @param counter  dither counter; advanced by n
+ * @return the number of samples that were clipped
+ */
+template <typename Traits>
+std::size_t
+float_to_int(sample_t const * __restrict__ in, typename Traits::value_type * __restrict__ out,
+             std::size_t n, bool dither, boost::uint32_t & counter)
+{
+        float const scale = Traits::full_scale();
+        float const hi = Traits::max();
+        float const lo = Traits::min();
+        float const dscale = dither ? 1.0f / 65536.0f : 0.0f;
+        boost::uint32_t const base = counter;
+        unsigned int clipped = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+                // integer hash of the counter gives two 16-bit uniform values
+                boost::uint32_t h = (base + boost::uint32_t(i)) * 0x9e3779b1U;
+                h ^= h >> 15;
+                h *= 0x85ebca77U;
+                h ^= h >> 13;
+                float d = float(int(h & 0xffff) - int(h >> 16)) * dscale;
+                float v = in[i] * scale + d;
+                // round half away from zero, then clip and truncate. (this
+                // order keeps the loop free of branches)
+                v += (v < 0.0f) ? -0.5f : 0.5f;
+                clipped += (v >= hi + 1.0f) | (v <= lo - 1.0f);
+                v = (v > hi) ? hi : v;
+                v = (v < lo) ? lo : v;
+                out[i] = typename Traits::value_type(v);
+        }
+        counter = base + boost::uint32_t(n);
+        return clipped;
+}
+
+}} // namespace jill::dsp
+
+#endif
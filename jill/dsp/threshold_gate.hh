@@ -0,0 +1,181 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _THRESHOLD_GATE_HH
+#define _THRESHOLD_GATE_HH
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup miscgroup
+ * @brief zero out samples that don't cross a threshold
+ *
+ * The gate passes samples that are above the threshold, below it, or whose
+ * absolute value is above it, depending on the mode. With a hysteresis h, the
+ * gate opens when a sample crosses the threshold but doesn't close until a
+ * sample crosses back past threshold - h (or threshold + h for the below
+ * mode). With attack and release times, the gain ramps linearly between 0 and
+ * 1 when the gate opens and closes, to avoid clicks.
+ *
+ * The mode and options are resolved when the gate is constructed. Without
+ * hysteresis or ramps, the gate is a branch-free select that the compiler
+ * vectorizes. Otherwise the state is tracked sample by sample, but blocks in
+ * which the gate stays fully open or fully closed are copied or zeroed
+ * whole, so the serial path only runs around transitions.
+ *
+ * The gate holds no per-channel state; each channel needs its own state.
+ */
+class threshold_gate {
+public:
+        enum mode_type { ABOVE, BELOW, ABS };
+
+        /** The state of the gate for one channel */
+        struct state {
+                bool open;
+                float gain;
+        };
+
+        /** The number of samples checked together in the stateful path */
+        enum { lanes = 8 };
+
+        /**
+         * @param mode        which samples to pass
+         * @param threshold   the threshold for opening the gate
+         * @param hysteresis  how far back past the threshold a sample must go
+         *                    to close the gate
+         * @param attack      the number of frames for the gain to reach 1
+         * @param release     the number of frames for the gain to reach 0
+         */
+        threshold_gate(mode_type mode, sample_t threshold, sample_t hysteresis=0,
+                       nframes_t attack=0, nframes_t release=0)
+                : _mode(mode), _open(threshold),
+                  _close((mode == BELOW) ? threshold + hysteresis : threshold - hysteresis),
+                  _attack(attack ? 1.0f / attack : 1.0f),
+                  _release(release ? 1.0f / release : 1.0f) {
+                bool stateful = (hysteresis != 0 || attack > 1 || release > 1);
+                switch (mode) {
+                case ABOVE:
+                        _process = stateful ? &threshold_gate::process_stateful<ABOVE>
+                                : &threshold_gate::process_simple<ABOVE>;
+                        break;
+                case BELOW:
+                        _process = stateful ? &threshold_gate::process_stateful<BELOW>
+                                : &threshold_gate::process_simple<BELOW>;
+                        break;
+                default:
+                        _process = stateful ? &threshold_gate::process_stateful<ABS>
+                                : &threshold_gate::process_simple<ABS>;
+                }
+        }
+
+        /** Parse a mode name (above, below, or abs) */
+        static mode_type parse_mode(std::string const & name) {
+                if (name == "above") return ABOVE;
+                else if (name == "below") return BELOW;
+                else if (name == "abs") return ABS;
+                throw std::invalid_argument("unknown gate mode: " + name);
+        }
+
+        /** The name of a mode */
+        static char const * mode_name(mode_type mode) {
+                static char const * names[] = { "above", "below", "abs" };
+                return names[mode];
+        }
+
+        /** The initial state: closed, with no gain */
+        static state initial_state() {
+                state s = { false, 0.0f };
+                return s;
+        }
+
+        mode_type mode() const { return _mode; }
+
+        /** Gate a buffer of samples. in and out may not overlap */
+        void process(state & s, sample_t const * in, sample_t * out, nframes_t nframes) const {
+                (this->*_process)(s, in, out, nframes);
+        }
+
+private:
+        typedef void (threshold_gate::*process_fn)(state &, sample_t const *, sample_t *,
+                                                   nframes_t) const;
+
+        /* does x cross the threshold t in the direction for Mode */
+        template <int Mode>
+        static bool crosses(sample_t x, sample_t t) {
+                return (Mode == ABOVE) ? (x > t) : (Mode == BELOW) ? (x < t) : (std::fabs(x) > t);
+        }
+
+        template <int Mode>
+        void process_simple(state &, sample_t const * __restrict__ in,
+                            sample_t * __restrict__ out, nframes_t nframes) const {
+                sample_t const t = _open;
+                for (nframes_t i = 0; i < nframes; ++i)
+                        out[i] = crosses<Mode>(in[i], t) ? in[i] : 0.0f;
+        }
+
+        template <int Mode>
+        void process_stateful(state & s, sample_t const * __restrict__ in,
+                              sample_t * __restrict__ out, nframes_t nframes) const {
+                nframes_t i = 0;
+                while (i < nframes) {
+                        nframes_t const n = std::min<nframes_t>(lanes, nframes - i);
+                        // if the gate can't change state in this block, skip the serial loop
+                        if (n == lanes && s.open && s.gain == 1.0f) {
+                                int hold = 0;
+                                for (int j = 0; j < lanes; ++j)
+                                        hold += crosses<Mode>(in[i + j], _close);
+                                if (hold == lanes) {
+                                        for (int j = 0; j < lanes; ++j) out[i + j] = in[i + j];
+                                        i += lanes;
+                                        continue;
+                                }
+                        }
+                        else if (n == lanes && !s.open && s.gain == 0.0f) {
+                                int opens = 0;
+                                for (int j = 0; j < lanes; ++j)
+                                        opens += crosses<Mode>(in[i + j], _open);
+                                if (opens == 0) {
+                                        for (int j = 0; j < lanes; ++j) out[i + j] = 0.0f;
+                                        i += lanes;
+                                        continue;
+                                }
+                        }
+                        for (nframes_t j = i; j < i + n; ++j) {
+                                if (s.open)
+                                        s.open = crosses<Mode>(in[j], _close);
+                                else
+                                        s.open = crosses<Mode>(in[j], _open);
+                                if (s.open)
+                                        s.gain = std::min(s.gain + _attack, 1.0f);
+                                else
+                                        s.gain = std::max(s.gain - _release, 0.0f);
+                                out[j] = in[j] * s.gain;
+                        }
+                        i += n;
+                }
+        }
+
+        mode_type _mode;
+        sample_t _open;         // threshold for opening the gate
+        sample_t _close;        // threshold for keeping it open
+        float _attack;          // gain increment per sample while open
+        float _release;         // gain decrement per sample while closed
+        process_fn _process;
+};
+
+}} // namespace jill::dsp
+
+#endif
@@ -1,3 +1,5 @@
+#include <cassert>
+#include <algorithm>
 #include <boost/type_traits/make_signed.hpp>
 
 #include "triggered_data_writer.hh"
@@ -29,10 +31,30 @@ triggered_data_writer::triggered_data_writer(boost::shared_ptr<data_writer> writ
                                              string const & trigger_port,
                                              nframes_t pretrigger_frames, nframes_t posttrigger_frames)
         : buffered_data_writer(writer),
-          _trigger_port(trigger_port),
           _pretrigger(pretrigger_frames),
           _posttrigger(std::max(posttrigger_frames, 1U)),
-          _recording(false)
+          _merge(0),
+          _period_size(0),
+          _current_size(0),
+          _xrun_pending(false),
+          _have_xrun(false),
+          _xrun_time(0)
+{
+        DBG << "triggered_data_writer initializing";
+        add_group(trigger_port, writer);
+}
+
+triggered_data_writer::triggered_data_writer(boost::shared_ptr<data_writer> writer,
+                                             nframes_t pretrigger_frames, nframes_t posttrigger_frames)
+        : buffered_data_writer(writer),
+          _pretrigger(pretrigger_frames),
+          _posttrigger(std::max(posttrigger_frames, 1U)),
+          _merge(0),
+          _period_size(0),
+          _current_size(0),
+          _xrun_pending(false),
+          _have_xrun(false),
+          _xrun_time(0)
 {
         DBG << "triggered_data_writer initializing";
 }
@@ -44,46 +66,82 @@ triggered_data_writer::~triggered_data_writer()
         join();
 }
 
+void
+triggered_data_writer::add_group(string const & trigger_port,
+                                 boost::shared_ptr<data_writer> writer,
+                                 vector<string> const & channels)
+{
+        assert(_state == Stopped);
+        trigger_group group;
+        group.trigger_port = trigger_port;
+        group.channels = channels;
+        if (!channels.empty() &&
+            find(channels.begin(), channels.end(), trigger_port) == channels.end())
+                group.channels.push_back(trigger_port);
+        group.writer = writer;
+        group.recording = false;
+        group.last_offset = 0;
+        _groups.push_back(group);
+        DBG << "trigger group " << _groups.size() << ": trigger=" << trigger_port
+            << ", channels=" << (channels.empty() ? string("all") : string("selected"));
+}
+
+bool
+triggered_data_writer::trigger_group::owns(data_block_t const * data) const
+{
+        if (channels.empty()) return true;
+        for (vector<string>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+                if (data->id_matches(*it)) return true;
+        }
+        return false;
+}
+
 /*
  * This function handles opening a new entry and writing data in the prebuffer.
- * The event_time argument indicates the time when the trigger event occurred,
- * so we start at the tail of the ringbuffer and search for the sample with
- * index event_time - _pretrigger
+ * The event_time argument indicates the time when the trigger event occurred.
+ * The blocks in the prebuffer stay in the ringbuffer (other groups may need
+ * them), so we use the period index to find the first period that overlaps
+ * event_time - _pretrigger, and then walk forward to the current block.
  */
 void
-triggered_data_writer::start_recording(nframes_t event_time)
+triggered_data_writer::start_recording(trigger_group & group, nframes_t event_time)
 {
         nframes_t onset = event_time - _pretrigger;
-        _writer->new_entry(onset);
+        group.writer->new_entry(onset);
 
-        INFO << "writing pretrigger data from " << onset << "--" << event_time;
-        /* start at tail of queue and find onset */
-        data_block_t const * ptr = _buffer->peek();
-        assert(ptr);
+        INFO << "writing pretrigger data from " << onset << "--" << event_time
+             << " (trigger " << group.trigger_port << ")";
 
-        /* skip any earlier periods */
-        while (ptr->time + ptr->nframes() < onset) {
-                _buffer->release();
-                ptr = _buffer->peek();
-        }
+        size_t const current = current_block_position();
+        size_t pos = _buffer->read_position();
 
-        /* write partial period(s) */
-        while (ptr->time <= onset) {
-                DBG << "prebuf frame: t=" << ptr->time << ", on=" << onset - ptr->time
-                    << ", id=" << ptr->id() << ", dtype=" << ptr->dtype;
-                _writer->write(ptr, onset - ptr->time, 0);
-                _buffer->release();
-                ptr = _buffer->peek();
+        /* use the index to skip any complete periods that end before the onset */
+        first_period();
+        for (size_t i = 0; i < _periods->read_space(); ++i) {
+                period_mark_t const * period = _periods->buffer() + _periods->read_offset() + i;
+                if (period->end > current ||
+                    (framediff_t)(onset - (period->time + period->nframes)) < 0)
+                        break;
+                pos = period->end;
         }
 
-        /* write additional periods in prebuffer, up to current period */
-        while (ptr->time + ptr->nframes() <= event_time) {
-                _writer->write(ptr, 0, 0);
-                _buffer->release();
-                ptr = _buffer->peek();
+        /* write any blocks up to the current one that overlap the onset */
+        while (pos < current) {
+                data_block_t const * ptr = _buffer->block_at(pos);
+                assert(ptr);
+                framediff_t start = onset - ptr->time;
+                if (group.owns(ptr) && (framediff_t)(start - ptr->nframes()) < 0) {
+                        DBG << "prebuf frame: t=" << ptr->time << ", on=" << start
+                            << ", id=" << ptr->id() << ", dtype=" << ptr->dtype;
+                        group.writer->write(ptr, (start > 0) ? (nframes_t)start : 0, 0);
+                }
+                pos += ptr->size();
         }
+        // the pretrigger data may span an xrun that was marked in an older entry
+        if (_have_xrun && (framediff_t)(_xrun_time - onset) > 0)
+                group.writer->xrun();
 
-        _recording = true;
+        group.recording = true;
 }
 
 /*
@@ -91,71 +149,143 @@ triggered_data_writer::start_recording(nframes_t event_time)
  * write() will do this at the appropriate time
  */
 void
-triggered_data_writer::stop_recording(nframes_t event_time)
+triggered_data_writer::stop_recording(trigger_group & group, nframes_t event_time)
+{
+        group.recording = false;
+        group.last_offset = event_time + _posttrigger;
+        INFO << "writing posttrigger data from " << event_time << "--" << group.last_offset
+             << " (trigger " << group.trigger_port << ")";
+}
+
+/*
+ * If the group is writing posttrigger data, the onset at event_time is within
+ * the merge window of the last offset, and the rest of the period can still be
+ * written in full, go back to recording in the current entry.
+ */
+bool
+triggered_data_writer::extend_recording(trigger_group & group, nframes_t event_time)
+{
+        if (_merge == 0 || !group.writer->ready())
+                return false;
+        nframes_t offset_time = group.last_offset - _posttrigger;
+        if ((framediff_t)(event_time - offset_time) > (framediff_t)_merge ||
+            (framediff_t)(group.last_offset - (event_time + _period_size)) < 0)
+                return false;
+        group.recording = true;
+        INFO << "extending entry from offset at " << offset_time << " to onset at " << event_time
+             << " (trigger " << group.trigger_port << ")";
+        return true;
+}
+
+/* the position in the ringbuffer of the start of the block passed to write() */
+size_t
+triggered_data_writer::current_block_position() const
 {
-        _recording = false;
-        _last_offset = event_time + _posttrigger;
-        INFO << "writing posttrigger data from " << event_time << "--" << _last_offset;
+        // the read-ahead pointer is at the end of the current block
+        return _buffer->read_position() + _buffer->read_ahead_space() - _current_size;
 }
 
 void
 triggered_data_writer::write(data_block_t const * data)
 {
-        std::string id = data->id();
-        nframes_t nframes = data->nframes();
-        /* handle trigger channel */
-        if (data->dtype == EVENT && id == _trigger_port) {
-                if (_recording) {
-                        if (midi::is_offset(data->data(), data->sz_data)) {
-                                DBG << "trigger off event: time=" << data->time;
-                                stop_recording(data->time);
+        typedef vector<trigger_group>::iterator iterator;
+        _current_size = data->size();
+        if (data->dtype == SAMPLED)
+                _period_size = data->nframes();
+        if (_xrun_pending) {
+                // data before this block may be missing
+                _xrun_time = data->time;
+                _have_xrun = true;
+                _xrun_pending = false;
+        }
+        else if (_have_xrun && (framediff_t)(data->time - _xrun_time) > (framediff_t)_pretrigger) {
+                // no onset from here on can reach back before the xrun. The
+                // frame difference wraps, so the xrun time can't be kept
+                _have_xrun = false;
+        }
+
+        /* handle trigger channels */
+        if (data->dtype == EVENT) {
+                for (iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                        if (!data->id_matches(g->trigger_port)) continue;
+                        if (g->recording) {
+                                if (midi::is_offset(data->data(), data->sz_data)) {
+                                        DBG << "trigger off event: time=" << data->time;
+                                        stop_recording(*g, data->time);
+                                }
                         }
-                }
-                else {
-                        if (midi::is_onset(data->data(), data->sz_data)) {
-                                DBG << "trigger on event: time=" << data->time;
-                                start_recording(data->time);
+                        else {
+                                if (midi::is_onset(data->data(), data->sz_data)) {
+                                        DBG << "trigger on event: time=" << data->time;
+                                        if (!extend_recording(*g, data->time))
+                                                start_recording(*g, data->time);
+                                }
                         }
                 }
         }
 
-        if (_recording) {
-                // Executed when an onset trigger has occurred and
-                // stop_recording was not called, so write full block.
-
-                // sanity check if data is flushed. can't compare pointers
-                // directly because the same data may have multiple addresses in
-                // the buffer
-                data_block_t const * tail = _buffer->peek();
-                assert(tail->time == data->time && tail->id() == id);
-                _writer->write(data, 0, 0);
-                _buffer->release();
-                if (__sync_bool_compare_and_swap(&_reset, true, false)) {
-                        stop_recording(data->time + nframes);
-                }
-        }
-        else if (_writer->ready()) {
-                // executed when stop_recording was called, so we're writing
-                // post-trigger periods. If enough data has been written, close
-                // entry.
-                framediff_t compare = _last_offset - data->time;
-                if (compare < 0) {
-                        _writer->close_entry();
+        for (iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                if (!g->writer->ready() || !g->owns(data)) continue;
+                if (g->recording) {
+                        // Executed when an onset trigger has occurred and
+                        // stop_recording was not called, so write full block.
+                        g->writer->write(data, 0, 0);
                 }
                 else {
-                        _writer->write(data, 0, (nframes_t)compare);
+                        // executed when stop_recording was called, so we're
+                        // writing post-trigger periods. If enough data has
+                        // been written, close entry.
+                        framediff_t compare = g->last_offset - data->time;
+                        if (compare < 0) {
+                                g->writer->close_entry();
+                        }
+                        else {
+                                g->writer->write(data, 0, (nframes_t)compare);
+                        }
                 }
-                _buffer->release();
         }
-        else {
-                // not writing: drop blocks on tail of queue as needed
-                data_block_t const * tail = _buffer->peek();
-                while (tail && (data->time + nframes) - (tail->time + nframes) > _pretrigger) {
-                        _buffer->release();
-                        tail = _buffer->peek();
+
+        if (__sync_bool_compare_and_swap(&_reset, true, false)) {
+                for (iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                        if (g->recording) stop_recording(*g, data->time + data->nframes());
                 }
-                // clear reset flag; otherwise it won't happen until the next
-                // recording starts
-                __sync_bool_compare_and_swap(&_reset, true, false);
         }
+
+        // drop complete periods on tail of queue that are older than the
+        // pretrigger window. Everything after the tail has already been
+        // written by any group that needs it.
+        period_mark_t const * period = first_period();
+        while (period && period->end <= current_block_position() &&
+               (framediff_t)(data->time - period->time) > (framediff_t)_pretrigger) {
+                _buffer->release_to(period->end);
+                period = first_period();
+        }
+}
+
+void
+triggered_data_writer::mark_xrun()
+{
+        _xrun_pending = true;
+        for (vector<trigger_group>::iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                if (g->writer != _writer) g->writer->xrun();
+        }
+        _writer->xrun();
+}
+
+void
+triggered_data_writer::flush_writers()
+{
+        for (vector<trigger_group>::iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                if (g->writer != _writer) g->writer->flush();
+        }
+        _writer->flush();
+}
+
+void
+triggered_data_writer::close_entries()
+{
+        for (vector<trigger_group>::iterator g = _groups.begin(); g != _groups.end(); ++g) {
+                if (g->writer != _writer) g->writer->close_entry();
+        }
+        _writer->close_entry();
 }
@@ -1,6 +1,8 @@
 #ifndef _TRIGGERED_DATA_WRITER_HH
 #define _TRIGGERED_DATA_WRITER_HH
 
+#include <string>
+#include <vector>
 #include "buffered_data_writer.hh"
 
 namespace jill { namespace dsp {
@@ -17,13 +19,25 @@ namespace jill { namespace dsp {
  *
  * "prebuffering" is provided, so that data before an onset event can be written
  * to disk.  Similarly, the object can be configured to continue writing for
- * some time after an offset event.
+ * some time after an offset event. The prebuffer is trimmed a period at a time
+ * using the period index, so the cost doesn't depend on the number of channels.
+ *
+ * Several trigger groups can share the ringbuffer and writer thread. Each group
+ * has its own trigger channel, set of recorded channels, and data_writer, and
+ * each goes through the idle/recording/posttrigger states independently. Blocks
+ * are written as they arrive at the head of the buffer, and the tail is only
+ * released once it's older than the pretrigger window.
+ *
+ * Optionally, onset events that arrive shortly after an offset (while the
+ * posttrigger data are being written) can extend the current entry instead of
+ * closing it and starting a new one. See set_merge_window().
  */
 class triggered_data_writer : public buffered_data_writer {
         friend class triggered_data_writer_test;
 public:
         /**
-         * Initialize buffered writer.
+         * Initialize buffered writer with a single trigger group that records
+         * all channels.
          *
          * @param writer              the sink for the data
          * @param trigger_port        id of channel carrying of trigger events
@@ -36,25 +50,88 @@ public:
                               std::string const & trigger_port,
                               nframes_t pretrigger_frames, nframes_t posttrigger_frames);
 
+        /**
+         * Initialize buffered writer with no trigger groups. Use add_group()
+         * to add them.
+         *
+         * @param writer              the sink for log messages
+         * @param pretrigger_frames   the number of frames to record from before
+         *                            trigger onset events
+         * @param posttrigger_frames  the number of frames to record from after
+         *                            trigger offset events
+         */
+        triggered_data_writer(boost::shared_ptr<data_writer> writer,
+                              nframes_t pretrigger_frames, nframes_t posttrigger_frames);
+
         ~triggered_data_writer();
 
+        /**
+         * Add a trigger group. Call before start().
+         *
+         * @param trigger_port  id of channel carrying trigger events for the group
+         * @param writer        the sink for the group's entries. Each group
+         *                      needs its own writer.
+         * @param channels      ids of the channels to record in the group's
+         *                      entries. If empty, all channels are recorded.
+         *                      The trigger channel is always recorded.
+         */
+        void add_group(std::string const & trigger_port,
+                       boost::shared_ptr<data_writer> writer,
+                       std::vector<std::string> const & channels=std::vector<std::string>());
+
+        /** The number of trigger groups */
+        std::size_t ngroups() const { return _groups.size(); }
+
+        /**
+         * Set the merge window. If an onset event arrives within this many
+         * frames of the preceding offset event, the current entry is extended
+         * rather than closed. Only onsets that arrive while posttrigger data
+         * are still being written (at least one period before the end of the
+         * posttrigger window) can be merged. The default is 0, which disables
+         * merging. Call before start().
+         */
+        void set_merge_window(nframes_t frames) { _merge = frames; }
+        nframes_t merge_window() const { return _merge; }
+
 protected:
 
         /** @see buffered_data_writer::write() */
         void write(data_block_t const *);
 
+        void mark_xrun();
+        void flush_writers();
+        void close_entries();
+
 private:
+        struct trigger_group {
+                std::string trigger_port;
+                std::vector<std::string> channels;      // empty for all
+                boost::shared_ptr<data_writer> writer;
+                bool recording;         // flag to track whether data are being written
+                nframes_t last_offset;  // track time since last offset
+
+                bool owns(data_block_t const * data) const;
+        };
+
         /** start recording at time - pretrigger */
-        void start_recording(nframes_t time);
+        void start_recording(trigger_group & group, nframes_t time);
         /** stop recording at time + posttrigger */
-        void stop_recording(nframes_t time);
+        void stop_recording(trigger_group & group, nframes_t time);
+        /** resume recording in the current entry, if time is in the merge window */
+        bool extend_recording(trigger_group & group, nframes_t time);
+        /** position of the block being written (see ringbuffer::read_position()) */
+        std::size_t current_block_position() const;
 
-        std::string _trigger_port;
+        std::vector<trigger_group> _groups;
         const nframes_t _pretrigger;
         const nframes_t _posttrigger;
+        nframes_t _merge;
 
-        bool _recording;        // flag to track whether data are being written
-        nframes_t _last_offset; // track time since last offset
+        nframes_t _period_size;    // frames in the most recent sampled block
+        std::size_t _current_size; // size of the block being written
+        bool _xrun_pending;        // an xrun was marked but no data has arrived since
+        bool _have_xrun;
+        nframes_t _xrun_time;      // the time of the first block after the last xrun
 };
 
 }}
@@ -1,4 +1,6 @@
+#include <pthread.h>
 #include <arf.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #define BOOST_UUID_NO_TYPE_TRAITS
 #include <boost/uuid/random_generator.hpp>
@@ -9,6 +11,8 @@
 #include "../logging.hh"
 #include "../data_source.hh"
 #include "../midi.hh"
+#include "../dsp/sample_convert.hh"
+#include "../util/thread_policy.hh"
 
 #define JILL_LOGDATASET_NAME "jill_log"
 #define ARF_CHUNK_SIZE 1024
@@ -40,22 +44,36 @@ struct event_t {
 };
 
 /**
- * convert a midi message to hex
+ * convert a midi message to hex, without allocating memory.
  * @param in   the midi message
  * @param size the length of the message
+ * @param out  output buffer, at least size * 2 + 3 bytes long
  */
-template <typename T>
-char *
-to_hex(T const * in, std::size_t size)
+static char *
+to_hex(boost::uint8_t const * in, std::size_t size, char * out)
 {
-        char * out = new char[size * 2 + 2];
-        sprintf(out, "0x");
+        static const char digits[] = "0123456789abcdef";
+        char * p = out;
+        *p++ = '0';
+        *p++ = 'x';
         for (std::size_t i = 0; i < size; ++i) {
-                sprintf(out + i*2 + 2, "%02x", in[i]);
+                *p++ = digits[in[i] >> 4];
+                *p++ = digits[in[i] & 0x0f];
         }
+        *p = '\0';
         return out;
 }
 
+/**
+ * @brief Storage format for the index of losslessly compressed chunks
+ */
+struct chunk_index_t {
+        boost::uint64_t offset; // byte offset of chunk in the data dataset
+        boost::uint64_t start;  // first frame in chunk, relative to entry start
+        boost::uint32_t nbytes; // size of chunk
+        boost::uint32_t nframes;// number of frames in chunk
+};
+
 // template specializations for compound data types
 namespace arf { namespace h5t { namespace detail {
 
@@ -89,79 +107,378 @@ struct datatype_traits<event_t> {
         }
 };
 
+template<>
+struct datatype_traits<dsp::overview_record> {
+	static hid_t value() {
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(dsp::overview_record));
+                H5Tinsert(ret, "min", HOFFSET(dsp::overview_record, min), H5T_NATIVE_FLOAT);
+                H5Tinsert(ret, "max", HOFFSET(dsp::overview_record, max), H5T_NATIVE_FLOAT);
+                H5Tinsert(ret, "rms", HOFFSET(dsp::overview_record, rms), H5T_NATIVE_FLOAT);
+                return ret;
+        }
+};
+
+template<>
+struct datatype_traits<chunk_index_t> {
+	static hid_t value() {
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(chunk_index_t));
+                H5Tinsert(ret, "offset", HOFFSET(chunk_index_t, offset), H5T_NATIVE_UINT64);
+                H5Tinsert(ret, "start", HOFFSET(chunk_index_t, start), H5T_NATIVE_UINT64);
+                H5Tinsert(ret, "nbytes", HOFFSET(chunk_index_t, nbytes), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "nframes", HOFFSET(chunk_index_t, nframes), H5T_NATIVE_UINT32);
+                return ret;
+        }
+};
+
+template<>
+struct datatype_traits<binary_event_t> {
+	static hid_t value() {
+                hsize_t dims = JILL_EVENT_INLINE_BYTES;
+                hid_t arr = H5Tarray_create(H5T_NATIVE_UINT8, 1, &dims);
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(binary_event_t));
+                H5Tinsert(ret, "start", HOFFSET(binary_event_t, start), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "status", HOFFSET(binary_event_t, status), H5T_NATIVE_UINT8);
+                H5Tinsert(ret, "size", HOFFSET(binary_event_t, size), H5T_NATIVE_UINT8);
+                H5Tinsert(ret, "data", HOFFSET(binary_event_t, data), arr);
+                H5Tclose(arr);
+                return ret;
+        }
+};
+
 }}}
 
+/*
+ * The file, log dataset, entry numbering, and rollover limits, which are shared
+ * by writers created with the sibling constructor. Also manages a thread that
+ * closes old files.
+ */
+struct arf_writer::file_state : boost::noncopyable {
+        string base_filename;           // name of the first file
+        string filename;                // name of the current file
+        arf::file_ptr file;
+        arf::packet_table_ptr log;
+        std::size_t entry_idx;          // index of the next entry
+        std::size_t spare_idx;          // serial number for the names of spare entries
+        std::size_t file_idx;           // serial number of the current file
+        std::size_t nentries;           // entries created in the current file
+        utime_t opened_usec;            // when the current file was opened
+
+        boost::uint64_t max_bytes;
+        utime_t max_usec;
+        std::size_t max_entries;
+
+        file_state(string const & name)
+                : base_filename(name), filename(name), entry_idx(0), spare_idx(0), file_idx(0),
+                  nentries(0),
+                  opened_usec(0), max_bytes(0), max_usec(0), max_entries(0),
+                  _closer_started(false), _closer_stopping(false) {
+                pthread_mutex_init(&_closer_lock, 0);
+                pthread_cond_init(&_closer_ready, 0);
+        }
+
+        ~file_state() {
+                if (_closer_started) {
+                        pthread_mutex_lock(&_closer_lock);
+                        _closer_stopping = true;
+                        pthread_cond_signal(&_closer_ready);
+                        pthread_mutex_unlock(&_closer_lock);
+                        pthread_join(_closer, 0);
+                }
+                pthread_cond_destroy(&_closer_ready);
+                pthread_mutex_destroy(&_closer_lock);
+        }
+
+        /** the name of the file with serial number idx */
+        string next_filename() const {
+                std::ostringstream name;
+                string::size_type sep = base_filename.find_last_of('/');
+                string::size_type ext = base_filename.find_last_of('.');
+                if (ext == string::npos || (sep != string::npos && ext < sep))
+                        ext = base_filename.length();
+                name << base_filename.substr(0, ext) << '_' << setw(4) << setfill('0')
+                     << file_idx + 1 << base_filename.substr(ext);
+                return name.str();
+        }
+
+        /**
+         * Release the caller's reference to a file. If the HDF5 library is
+         * thread-safe, the file is flushed and closed on the closing thread,
+         * so that writing out the metadata doesn't block the caller.
+         */
+        void close(arf::file_ptr & f, string const & name) {
+                hbool_t threadsafe = 0;
+                H5is_library_threadsafe(&threadsafe);
+                if (threadsafe) {
+                        pthread_mutex_lock(&_closer_lock);
+                        if (!_closer_started) {
+                                _closer_started = (pthread_create(&_closer, 0, closer_thread, this) == 0);
+                        }
+                        if (_closer_started) {
+                                _closing.push_back(make_pair(f, name));
+                                pthread_cond_signal(&_closer_ready);
+                        }
+                        pthread_mutex_unlock(&_closer_lock);
+                }
+                f.reset();
+        }
+
+private:
+        static void * closer_thread(void * arg) {
+                file_state * self = static_cast<file_state*>(arg);
+                util::thread_policy::apply("writer");
+                pthread_mutex_lock(&self->_closer_lock);
+                while (1) {
+                        while (!self->_closing.empty()) {
+                                pair<arf::file_ptr, string> f = self->_closing.front();
+                                self->_closing.erase(self->_closing.begin());
+                                pthread_mutex_unlock(&self->_closer_lock);
+                                f.first->flush();
+                                f.first.reset();  // closes file unless a writer still has it
+                                LOG << "closed file: " << f.second;
+                                pthread_mutex_lock(&self->_closer_lock);
+                        }
+                        if (self->_closer_stopping) break;
+                        pthread_cond_wait(&self->_closer_ready, &self->_closer_lock);
+                }
+                pthread_mutex_unlock(&self->_closer_lock);
+                return 0;
+        }
+
+        pthread_t _closer;
+        pthread_mutex_t _closer_lock;
+        pthread_cond_t _closer_ready;
+        std::vector<pair<arf::file_ptr, string> > _closing;
+        bool _closer_started;
+        bool _closer_stopping;
+};
+
 arf_writer::arf_writer(string const & filename,
                        data_source const & source,
                        map<string,string> const & entry_attrs,
                        int compression)
         : _data_source(source),
+          _state(new file_state(filename)),
           _attrs(entry_attrs),
-          _compression(compression),
-          _entry_start(0), _entry_idx(0)
+          _compression(compression), _event_format(EVENT_BINARY),
+          _sample_format(SAMPLE_FLOAT), _dither(false), _dither_counter(0),
+          _encoder_threads(2),
+          _overview_levels(0), _overview_base(256), _overview_factor(16),
+          _entry_start(0), _last_period(0)
 {
         _base_usec = _data_source.time();
         _base_ptime = microsec_clock::universal_time();
         LOG << "registered system clock to usec clock at " << _base_usec;
 
-        _file.reset(new arf::file(filename, "a"));
+        _log_text.reserve(log_batch_size);
+        _log_times.reserve(log_batch_size);
+        _open_file(filename);
+}
+
+arf_writer::arf_writer(arf_writer const & parent, map<string,string> const & entry_attrs)
+        : _data_source(parent._data_source),
+          _state(parent._state),
+          _attrs(parent._attrs),
+          _compression(parent._compression), _event_format(parent._event_format),
+          _sample_format(parent._sample_format), _channel_formats(parent._channel_formats),
+          _dither(parent._dither), _dither_counter(0),
+          _encoder_threads(parent._encoder_threads),
+          _overview_levels(parent._overview_levels), _overview_base(parent._overview_base),
+          _overview_factor(parent._overview_factor),
+          _base_ptime(parent._base_ptime), _base_usec(parent._base_usec),
+          _entry_start(0), _last_period(0)
+{
+        for (map<string,string>::const_iterator it = entry_attrs.begin(); it != entry_attrs.end(); ++it)
+                _attrs[it->first] = it->second;
+}
+
+void
+arf_writer::_open_file(string const & filename)
+{
+        arf::file_ptr file(new arf::file(filename, "a"));
         LOG << "opened file: " << filename;
-        if (!_file->has_attribute("file_creator")) {
-                _file->write_attribute("file_creator", "org.meliza.jill/jrecord " JILL_VERSION);
+        if (!file->has_attribute("file_creator")) {
+                file->write_attribute("file_creator", "org.meliza.jill/jrecord " JILL_VERSION);
         }
 
         // open/create log
         arf::h5t::wrapper<message_t> t;
         arf::h5t::datatype logtype(t);
-        if (_file->contains(JILL_LOGDATASET_NAME)) {
-                _log.reset(new arf::h5pt::packet_table(_file->hid(), JILL_LOGDATASET_NAME));
-                if (logtype != *(_log->datatype())) {
+        arf::packet_table_ptr log;
+        if (file->contains(JILL_LOGDATASET_NAME)) {
+                log.reset(new arf::h5pt::packet_table(file->hid(), JILL_LOGDATASET_NAME));
+                if (logtype != *(log->datatype())) {
                         throw arf::Exception(JILL_LOGDATASET_NAME " has wrong datatype");
                 }
                 INFO << "appending log messages to /" << JILL_LOGDATASET_NAME;
         }
         else {
-                _log.reset(new arf::h5pt::packet_table(_file->hid(), JILL_LOGDATASET_NAME,
-                                                       logtype, ARF_CHUNK_SIZE, _compression));
+                log.reset(new arf::h5pt::packet_table(file->hid(), JILL_LOGDATASET_NAME,
+                                                      logtype, ARF_CHUNK_SIZE, _compression));
                 INFO << "created log dataset /" << JILL_LOGDATASET_NAME;
         }
+        _state->file = file;
+        _state->log = log;
+        _state->filename = filename;
+        _state->nentries = 0;
+        _state->opened_usec = _data_source.time();
         _get_last_entry_index();
 }
 
+void
+arf_writer::set_rollover(boost::uint64_t max_bytes, double max_seconds, std::size_t max_entries)
+{
+        _state->max_bytes = max_bytes;
+        _state->max_usec = max_seconds * 1e6;
+        _state->max_entries = max_entries;
+        hbool_t threadsafe = 0;
+        H5is_library_threadsafe(&threadsafe);
+        if (!threadsafe && (max_bytes || max_seconds || max_entries)) {
+                LOG << "WARNING: HDF5 library is not thread-safe; old files will be closed "
+                    << "in the writer thread";
+        }
+}
+
+string const &
+arf_writer::filename() const
+{
+        return _state->filename;
+}
+
+bool
+arf_writer::_rollover_due() const
+{
+        file_state const & s = *_state;
+        if (s.nentries == 0) return false;
+        if (s.max_entries && s.nentries >= s.max_entries) return true;
+        return _file_limit_reached();
+}
+
+bool
+arf_writer::_file_limit_reached() const
+{
+        file_state const & s = *_state;
+        if (s.nentries == 0) return false;
+        if (s.max_usec && (_data_source.time() - s.opened_usec) >= s.max_usec) return true;
+        if (s.max_bytes) {
+                hsize_t size = 0;
+                if (H5Fget_filesize(s.file->hid(), &size) >= 0 && size >= s.max_bytes)
+                        return true;
+        }
+        return false;
+}
+
+void
+arf_writer::_rollover()
+{
+        _flush_log();
+        _discard_prepared_entry();
+        arf::file_ptr old = _state->file;
+        string old_name = _state->filename;
+        _state->log.reset();
+        _open_file(_state->next_filename());
+        _state->file_idx += 1;
+        _state->close(old, old_name);
+}
+
 arf_writer::~arf_writer()
-{}
+{
+        _flush_events();
+        _flush_log();
+        _discard_prepared_entry();
+        for (map<string, dsp::chunk_encoder::chunk *>::iterator it = _open_chunks.begin();
+             it != _open_chunks.end(); ++it) {
+                delete it->second;
+        }
+}
 
 void
 arf_writer::new_entry(nframes_t frame_count)
 {
         utime_t frame_usec = 0;
 
-        std::ostringstream name;
-        name << _data_source.name() << '_' << setw(4) << setfill('0') << _entry_idx++;
-
         close_entry();
+        if (_rollover_due()) {
+                _rollover();
+        }
+        // a spare entry in an old file (e.g. after another writer rolled over)
+        if (_next_file && _next_file != _state->file) {
+                _discard_prepared_entry();
+        }
         _entry_start = frame_count;
+        _state->nentries += 1;
 
         time_duration ts;
         frame_usec = _data_source.time(_entry_start);
         ts = (_base_ptime + microseconds(frame_usec - _base_usec)) - epoch;
 
-        _entry.reset(new arf::entry(*_file, name.str(),
-                                    ts.total_seconds(), ts.fractional_seconds()));
+        // the index is assigned here so that entries are numbered in order
+        string name = _next_entry_name();
+        if (_next_entry) {
+                // activate the prepared entry by moving it to its real name
+                hid_t fid = _next_file->hid();
+                if (H5Lmove(fid, _next_entry->name().c_str(), fid, name.c_str(),
+                            H5P_DEFAULT, H5P_DEFAULT) < 0) {
+                        LOG << "WARNING: unable to rename spare entry " << _next_entry->name();
+                        _discard_prepared_entry();
+                }
+        }
+        if (_next_entry) {
+                _entry.swap(_next_entry);
+                _dsets.swap(_next_dsets);
+                _next_entry.reset();
+                _next_dsets.clear();
+                _next_file.reset();
+        }
+        else {
+                _entry = _create_entry(name);
+        }
+        vector<boost::int64_t> timestamp(2);
+        timestamp[0] = ts.total_seconds();
+        timestamp[1] = ts.fractional_seconds();
+        _entry->write_attribute("timestamp", timestamp);
 
         LOG << "created entry: " << _entry->name() << " (frame=" << _entry_start << ")" ;
 
         arf::h5a::node::attr_writer a = _entry->write_attribute();
         a("jack_frame", _entry_start);
         a("jack_usec", frame_usec);
-        a("jack_sampling_rate", _data_source.sampling_rate());
-        a("entry_creator", "org.meliza.jill/jrecord " JILL_VERSION);
-        for_each(_attrs.begin(), _attrs.end(), a);
 }
 
 void
 arf_writer::close_entry()
 {
+        _flush_events();
+        if (_encoder) {
+                // encode any partial chunks and wait for the rest
+                for (map<string, dsp::chunk_encoder::chunk *>::iterator it = _open_chunks.begin();
+                     it != _open_chunks.end(); ++it) {
+                        if (it->second->samples.empty()) continue;
+                        _encoder->submit(it->second);
+                        it->second = _encoder->acquire();
+                        it->second->channel = it->first;
+                }
+                _write_chunks(true);
+                _chunk_index.clear();
+                _chunk_pos.clear();
+        }
+        _flush_overviews(true);
+        _overviews.clear();
+        _overview_dsets.clear();
+        for (map<string, boost::uint64_t>::const_iterator it = _clipped.begin();
+             it != _clipped.end(); ++it) {
+                dset_map_type::iterator dset = _dsets.find(it->first);
+                if (dset == _dsets.end()) continue;
+                dset->second->write_attribute("jill_clipped", it->second);
+                LOG << "WARNING: " << it->second << " samples clipped in " << dset->second->name();
+        }
+        _clipped.clear();
+        for (map<string, boost::uint64_t>::const_iterator it = _truncated.begin();
+             it != _truncated.end(); ++it) {
+                dset_map_type::iterator dset = _dsets.find(it->first);
+                if (dset == _dsets.end()) continue;
+                dset->second->write_attribute("jill_truncated", it->second);
+        }
+        _truncated.clear();
         _dsets.clear();         // release any old packet tables
         if (_entry) {
                 LOG << "closed entry: " << _entry->name() << " (frame=" << _last_frame << ")";
@@ -203,6 +520,14 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
                     << ", data=" << (data->time + start_frame) << ")";
                 close_entry();
         }
+        // split the entry at a period boundary if it's time for a new file
+        if (data->dtype == SAMPLED && data->time != _last_period) {
+                _last_period = data->time;
+                if (_entry && _entry_start != data->time && _file_limit_reached()) {
+                        LOG << "starting new file";
+                        close_entry();
+                }
+        }
         if (!_entry) {
                 new_entry(data->time);
         }
@@ -210,60 +535,326 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
         if (data->dtype == SAMPLED) {
                 dset = get_dataset(id, true);
                 sample_t const * samples = reinterpret_cast<sample_t const *>(data->data());
-                dset->second->write(samples + start_frame, stop_frame - start_frame);
+                switch (sample_format(id)) {
+                case SAMPLE_INT16:
+                        _write_converted<dsp::int16_sample>(dset, samples + start_frame,
+                                                            stop_frame - start_frame);
+                        break;
+                case SAMPLE_INT24:
+                        _write_converted<dsp::int24_sample>(dset, samples + start_frame,
+                                                            stop_frame - start_frame);
+                        break;
+                case SAMPLE_LOSSLESS16:
+                        _write_encoded<dsp::int_sample_traits<boost::int32_t, 16> >(
+                                dset, samples + start_frame, stop_frame - start_frame);
+                        break;
+                case SAMPLE_LOSSLESS24:
+                        _write_encoded<dsp::int24_sample>(dset, samples + start_frame,
+                                                          stop_frame - start_frame);
+                        break;
+                default:
+                        dset->second->write(samples + start_frame, stop_frame - start_frame);
+                }
+                if (_overview_levels > 0) {
+                        _update_overview(id, samples + start_frame, stop_frame - start_frame);
+                }
         }
         else if (data->dtype == EVENT) {
-                char * message = 0;
                 dset = get_dataset(id, false);
-                char const * buffer = reinterpret_cast<char const *>(data->data());
-                event_t e = {data->time - _entry_start, (uint8_t)buffer[0], buffer+1};
-                if (e.status >= midi::note_off) {
-                        // hex-encode standard midi events
-                        e.message = message = to_hex(buffer + 1, data->sz_data - 1);
+                boost::uint8_t const * buffer = reinterpret_cast<boost::uint8_t const *>(data->data());
+                std::size_t size = data->sz_data - 1;
+                if (_event_format == EVENT_BINARY) {
+                        std::vector<binary_event_t> & events = _events[id];
+                        events.push_back(binary_event_t());
+                        binary_event_t & e = events.back();
+                        e.start = data->time - _entry_start;
+                        e.status = buffer[0];
+                        e.size = std::min<std::size_t>(size, JILL_EVENT_INLINE_BYTES);
+                        memcpy(e.data, buffer + 1, e.size);
+                        memset(e.data + e.size, 0, JILL_EVENT_INLINE_BYTES - e.size);
+                        if (size > JILL_EVENT_INLINE_BYTES) {
+                                // strings keep their terminating null
+                                if (e.status < midi::note_off)
+                                        e.data[JILL_EVENT_INLINE_BYTES - 1] = 0;
+                                // counted in jill_truncated; only warn the first time
+                                ++_truncated[id];
+                                if (_truncation_warned.insert(id).second) {
+                                        LOG << "WARNING: event messages on " << id << " truncated to "
+                                            << JILL_EVENT_INLINE_BYTES << " bytes";
+                                }
+                        }
+                        DBG << "event: t=" << data->time << " id=" << id << " status=" << int(e.status)
+                            << " size=" << int(e.size);
+                        if (events.size() >= event_batch_size) {
+                                dset->second->write(&events[0], events.size());
+                                events.clear();
+                        }
+                }
+                else {
+                        char hex[size * 2 + 3];
+                        event_t e = {data->time - _entry_start, buffer[0],
+                                     reinterpret_cast<char const *>(buffer + 1)};
+                        if (e.status >= midi::note_off) {
+                                // hex-encode standard midi events
+                                e.message = to_hex(buffer + 1, size, hex);
+                        }
+                        DBG << "event: t=" << data->time << " id=" << id << " status=" << int(e.status)
+                            << " message=" << e.message;
+                        dset->second->write(&e, 1);
                 }
-                DBG << "event: t=" << data->time << " id=" << id << " status=" << int(e.status)
-                    << " message=" << e.message;
-                dset->second->write(&e, 1);
-                if (message) delete[] message;
         }
         _last_frame = data->time + stop_frame;
 }
 
+template <typename Traits>
+void
+arf_writer::_write_converted(dset_map_type::iterator dset, sample_t const * samples,
+                             std::size_t nframes)
+{
+        typedef typename Traits::value_type value_type;
+        std::size_t bytes = nframes * sizeof(value_type);
+        if (_convert_buf.size() < bytes) {
+                _convert_buf.resize(bytes);
+        }
+        value_type * out = reinterpret_cast<value_type *>(&_convert_buf[0]);
+        std::size_t clipped = dsp::float_to_int<Traits>(samples, out, nframes, _dither,
+                                                        _dither_counter);
+        if (clipped > 0) {
+                _clipped[dset->first] += clipped;
+        }
+        dset->second->write(out, nframes);
+}
+
+template <typename Traits>
+void
+arf_writer::_write_encoded(dset_map_type::iterator dset, sample_t const * samples,
+                           std::size_t nframes)
+{
+        if (!_encoder) {
+                _encoder.reset(new dsp::chunk_encoder(_encoder_threads));
+                INFO << "started " << _encoder->nthreads() << " encoder thread(s)";
+        }
+        dsp::chunk_encoder::chunk *& c = _open_chunks[dset->first];
+        if (c == 0) {
+                c = _encoder->acquire();
+                c->channel = dset->first;
+        }
+        while (nframes > 0) {
+                std::size_t offset = c->samples.size();
+                std::size_t n = std::min(nframes, chunk_frames - offset);
+                c->samples.resize(offset + n);
+                std::size_t clipped = dsp::float_to_int<Traits>(samples, &c->samples[offset], n,
+                                                                _dither, _dither_counter);
+                if (clipped > 0) {
+                        _clipped[dset->first] += clipped;
+                }
+                samples += n;
+                nframes -= n;
+                if (c->samples.size() == chunk_frames) {
+                        _encoder->submit(c);
+                        c = _encoder->acquire();
+                        c->channel = dset->first;
+                }
+        }
+        _write_chunks(false);
+}
+
+void
+arf_writer::_write_chunks(bool wait)
+{
+        if (!_encoder) return;
+        dsp::chunk_encoder::chunk * c;
+        while ((c = _encoder->next(wait))) {
+                dset_map_type::iterator dset = _dsets.find(c->channel);
+                if (dset != _dsets.end() && !c->data.empty()) {
+                        dset_map_type::iterator idx = _chunk_index.find(c->channel);
+                        if (idx == _chunk_index.end()) {
+                                arf::packet_table_ptr pt =
+                                        _entry->create_packet_table<chunk_index_t>(
+                                                c->channel + "_index", "", arf::UNDEFINED,
+                                                false, ARF_CHUNK_SIZE, 0);
+                                idx = _chunk_index.insert(idx, make_pair(c->channel, pt));
+                        }
+                        std::pair<boost::uint64_t, boost::uint64_t> & pos = _chunk_pos[c->channel];
+                        chunk_index_t rec = { pos.first, pos.second,
+                                              boost::uint32_t(c->data.size()),
+                                              boost::uint32_t(c->samples.size()) };
+                        dset->second->write(reinterpret_cast<boost::uint8_t const *>(&c->data[0]),
+                                            c->data.size());
+                        idx->second->write(&rec, 1);
+                        pos.first += c->data.size();
+                        pos.second += c->samples.size();
+                }
+                _encoder->release(c);
+        }
+}
+
+void
+arf_writer::_update_overview(string const & name, sample_t const * samples, std::size_t nframes)
+{
+        boost::shared_ptr<dsp::overview_pyramid> & p = _overviews[name];
+        if (!p) {
+                p.reset(new dsp::overview_pyramid(_overview_base, _overview_factor,
+                                                  _overview_levels));
+        }
+        p->push(samples, nframes);
+        // write only when the smallest bins have built up
+        if (p->records(0).size() >= overview_batch_size) {
+                _flush_overviews(false);
+        }
+}
+
+void
+arf_writer::_flush_overviews(bool finish)
+{
+        std::map<string, boost::shared_ptr<dsp::overview_pyramid> >::iterator it;
+        for (it = _overviews.begin(); it != _overviews.end(); ++it) {
+                dsp::overview_pyramid & p = *it->second;
+                if (finish) p.finish();
+                vector<arf::packet_table_ptr> & dsets = _overview_dsets[it->first];
+                for (std::size_t level = 0; level < p.nlevels(); ++level) {
+                        vector<dsp::overview_record> & records = p.records(level);
+                        if (records.empty()) continue;
+                        if (dsets.size() <= level) {
+                                std::ostringstream name;
+                                name << it->first << "_overview" << p.bin_size(level);
+                                arf::packet_table_ptr pt =
+                                        _entry->create_packet_table<dsp::overview_record>(
+                                                name.str(), "", arf::UNDEFINED, false,
+                                                ARF_CHUNK_SIZE, _compression);
+                                pt->write_attribute("jill_overview_of", it->first);
+                                pt->write_attribute("jill_bin_frames", p.bin_size(level));
+                                pt->write_attribute("sampling_rate", _data_source.sampling_rate());
+                                dsets.push_back(pt);
+                        }
+                        dsets[level]->write(&records[0], records.size());
+                        records.clear();
+                }
+        }
+}
+
+arf_writer::sample_format_t
+arf_writer::sample_format(string const & channel) const
+{
+        map<string, sample_format_t>::const_iterator it = _channel_formats.find(channel);
+        return (it == _channel_formats.end()) ? _sample_format : it->second;
+}
+
 void
 arf_writer::flush()
 {
-        _file->flush();
+        _write_chunks(false);
+        _flush_events();
+        _flush_log();
+        if (_next_file && _next_file != _state->file) {
+                _discard_prepared_entry();
+        }
+        // a writer that has never had any data (e.g. the parent of trigger
+        // groups) doesn't need a spare
+        if (!_entry && !_next_entry && !_dset_sampled.empty() && !_rollover_due()) {
+                _prepare_entry();
+        }
+        _state->file->flush();
 }
 
 void
 arf_writer::log(timestamp_t const &utc, string const & source, string const & msg)
 {
-        char m[msg.length() + source.length() + 4];
-        sprintf(m, "[%s] %s", source.c_str(), msg.c_str());
-
+        // messages are buffered and written in batches (see _flush_log)
         time_duration t = utc - epoch;
-        message_t message = { t.total_seconds(), t.fractional_seconds(), m };
-        _log->write(&message, 1);
+        _log_times.push_back(make_pair(t.total_seconds(), t.fractional_seconds()));
+        _log_text.push_back(string());
+        string & m = _log_text.back();
+        m.reserve(source.length() + msg.length() + 3);
+        m.append("[").append(source).append("] ").append(msg);
+        if (_log_text.size() >= log_batch_size) {
+                _flush_log();
+        }
+}
+
+void
+arf_writer::_flush_log()
+{
+        std::size_t n = _log_text.size();
+        if (n == 0) return;
+        vector<message_t> messages(n);
+        for (std::size_t i = 0; i < n; ++i) {
+                message_t & m = messages[i];
+                m.sec = _log_times[i].first;
+                m.usec = _log_times[i].second;
+                m.message = _log_text[i].c_str();
+        }
+        _state->log->write(&messages[0], n);
+        _log_text.clear();
+        _log_times.clear();
+}
+
+void
+arf_writer::_flush_events()
+{
+        std::map<string, vector<binary_event_t> >::iterator it;
+        for (it = _events.begin(); it != _events.end(); ++it) {
+                if (it->second.empty()) continue;
+                dset_map_type::iterator dset = _dsets.find(it->first);
+                if (dset != _dsets.end()) {
+                        dset->second->write(&it->second[0], it->second.size());
+                }
+                it->second.clear();
+        }
 }
 
 void
 arf_writer::_get_last_entry_index()
 {
         unsigned int val;
-        vector<string> entries = _file->children();  // read-only
+        vector<string> entries = _state->file->children();  // read-only
         for (vector<string>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                // don't reuse the name of a spare left behind by a crash
+                if (sscanf(it->c_str(), "jill_spare_%u", &val) == 1 && val >= _state->spare_idx)
+                        _state->spare_idx = val + 1;
                 char const * match = strstr(it->c_str(), _data_source.name());
                 if (match == 0) continue;
                 int rc = sscanf(match + strlen(_data_source.name()), "_%ud", &val);
                 val += 1;
-                if (rc == 1 && val > _entry_idx) _entry_idx = val;
+                if (rc == 1 && val > _state->entry_idx) _state->entry_idx = val;
         }
-        INFO << "last entry index: " << _entry_idx;
+        INFO << "last entry index: " << _state->entry_idx;
 }
 
 
 arf_writer::dset_map_type::iterator
 arf_writer::get_dataset(string const & name, bool is_sampled)
+{
+        dset_map_type::iterator dset = _dsets.find(name);
+        if (dset == _dsets.end()) {
+                arf::packet_table_ptr pt = _create_dataset(_entry, name, is_sampled);
+                dset = _dsets.insert(dset, make_pair(name,pt));
+        }
+        return dset;
+}
+
+string
+arf_writer::_next_entry_name()
+{
+        std::ostringstream name;
+        name << _data_source.name() << '_' << setw(4) << setfill('0') << _state->entry_idx++;
+        return name.str();
+}
+
+arf::entry_ptr
+arf_writer::_create_entry(string const & name)
+{
+        // the timestamp is set when the entry is activated
+        arf::entry_ptr entry(new arf::entry(*_state->file, name, 0, 0));
+        arf::h5a::node::attr_writer a = entry->write_attribute();
+        a("jack_sampling_rate", _data_source.sampling_rate());
+        a("entry_creator", "org.meliza.jill/jrecord " JILL_VERSION);
+        for_each(_attrs.begin(), _attrs.end(), a);
+        return entry;
+}
+
+arf::packet_table_ptr
+arf_writer::_create_dataset(arf::entry_ptr entry, string const & name, bool is_sampled)
 {
         map<string, string>::iterator uuid = _dset_uuids.find(name);
         if (uuid == _dset_uuids.end()) {
@@ -272,27 +863,85 @@ arf_writer::get_dataset(string const & name, bool is_sampled)
                 uuid = _dset_uuids.insert(uuid, make_pair(name, _uuid));
                 INFO << "uuid for " << name << ": " << uuid->second;
         }
-
-        dset_map_type::iterator dset = _dsets.find(name);
-        if (dset == _dsets.end()) {
-                arf::packet_table_ptr pt;
-                if (is_sampled) {
-                        pt = _entry->create_packet_table<sample_t>(name, "", arf::UNDEFINED,
-                                                                   false, ARF_CHUNK_SIZE,
-                                                                   _compression);
-                }
-                else {
-                        pt = _entry->create_packet_table<event_t>(name, "samples", arf::EVENT,
-                                                                  false, ARF_CHUNK_SIZE,
-                                                                  _compression);
-                }
-                pt->write_attribute("sampling_rate", _data_source.sampling_rate());
-                pt->write_attribute("uuid", uuid->second);
-                LOG << "created dataset: " << pt->name();
-                dset = _dsets.insert(dset, make_pair(name,pt));
+        _dset_sampled[name] = is_sampled;
+
+        arf::packet_table_ptr pt;
+        sample_format_t fmt = sample_format(name);
+        if (is_sampled && fmt == SAMPLE_INT16) {
+                pt = entry->create_packet_table<boost::int16_t>(name, "", arf::UNDEFINED,
+                                                                false, ARF_CHUNK_SIZE,
+                                                                _compression);
+                pt->write_attribute("jill_scale", 1.0 / dsp::int16_sample::full_scale());
+                pt->write_attribute("jill_dither", int(_dither));
+        }
+        else if (is_sampled && fmt == SAMPLE_INT24) {
+                pt = entry->create_packet_table<boost::int32_t>(name, "", arf::UNDEFINED,
+                                                                false, ARF_CHUNK_SIZE,
+                                                                _compression);
+                pt->write_attribute("jill_scale", 1.0 / dsp::int24_sample::full_scale());
+                pt->write_attribute("jill_dither", int(_dither));
+        }
+        else if (is_sampled && (fmt == SAMPLE_LOSSLESS16 || fmt == SAMPLE_LOSSLESS24)) {
+                // the data are already compressed
+                pt = entry->create_packet_table<boost::uint8_t>(name, "", arf::UNDEFINED,
+                                                                false, ARF_CHUNK_SIZE * 4, 0);
+                pt->write_attribute("jill_codec", "rice-fixed");
+                pt->write_attribute("jill_chunk_index", name + "_index");
+                pt->write_attribute("jill_scale", (fmt == SAMPLE_LOSSLESS16) ?
+                                    1.0 / dsp::int16_sample::full_scale() :
+                                    1.0 / dsp::int24_sample::full_scale());
+                pt->write_attribute("jill_dither", int(_dither));
+        }
+        else if (is_sampled) {
+                pt = entry->create_packet_table<sample_t>(name, "", arf::UNDEFINED,
+                                                          false, ARF_CHUNK_SIZE,
+                                                          _compression);
+        }
+        else if (_event_format == EVENT_BINARY) {
+                pt = entry->create_packet_table<binary_event_t>(name, "samples", arf::EVENT,
+                                                                false, ARF_CHUNK_SIZE,
+                                                                _compression);
+                pt->write_attribute("jill_event_format", "binary");
+        }
+        else {
+                pt = entry->create_packet_table<event_t>(name, "samples", arf::EVENT,
+                                                         false, ARF_CHUNK_SIZE,
+                                                         _compression);
         }
+        pt->write_attribute("sampling_rate", _data_source.sampling_rate());
+        pt->write_attribute("uuid", uuid->second);
+        LOG << "created dataset: " << pt->name();
+        return pt;
+}
 
-        return dset;
+void
+arf_writer::_prepare_entry()
+{
+        // the spare gets its index when it's activated (see new_entry)
+        std::ostringstream name;
+        name << "jill_spare_" << setw(4) << setfill('0') << _state->spare_idx++;
+        _next_entry = _create_entry(name.str());
+        _next_file = _state->file;
+        for (map<string,bool>::const_iterator it = _dset_sampled.begin();
+             it != _dset_sampled.end(); ++it) {
+                _next_dsets[it->first] = _create_dataset(_next_entry, it->first, it->second);
+        }
+        DBG << "prepared entry: " << _next_entry->name() << " (" << _next_dsets.size()
+            << " datasets)";
+}
 
+void
+arf_writer::_discard_prepared_entry()
+{
+        if (!_next_entry) return;
+        string name = _next_entry->name();
+        _next_dsets.clear();
+        _next_entry.reset();
+        // the entry is empty, so it can just be unlinked
+        if (H5Ldelete(_next_file->hid(), name.c_str(), H5P_DEFAULT) < 0) {
+                LOG << "WARNING: unable to remove unused entry " << name;
+        }
+        _next_file.reset();
+        DBG << "removed unused entry: " << name;
 }
 
@@ -2,11 +2,17 @@
 #define _ARF_WRITER_HH
 
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <iosfwd>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 #include <arf/types.hpp>
 
 #include "../data_writer.hh"
+#include "../dsp/chunk_encoder.hh"
+#include "../dsp/overview.hh"
 
 namespace jill {
 
@@ -14,11 +20,74 @@ namespace jill {
 
 namespace file {
 
+/** The number of message bytes stored inline in binary event records */
+#define JILL_EVENT_INLINE_BYTES 58
+
+/**
+ * @brief Storage format for event data in binary mode
+ *
+ * A fixed-size record, so events can be appended to the dataset in batches
+ * without any per-event allocation. Messages longer than
+ * JILL_EVENT_INLINE_BYTES are truncated; string messages (status below
+ * midi::note_off) keep a terminating null. The number of truncated events in
+ * each dataset is stored in its jill_truncated attribute.
+ */
+struct binary_event_t {
+        boost::uint32_t start;  // relative to entry start
+        boost::uint8_t status;  // see jill::midi
+        boost::uint8_t size;    // number of valid bytes in data
+        boost::uint8_t data[JILL_EVENT_INLINE_BYTES];
+};
+
 /**
  * Class for storing data in an ARF file. Access is not thread-safe.
+ *
+ * Log messages are held in memory and appended to the log dataset in batches,
+ * when log_batch_size messages have accumulated or when flush() is called.
+ *
+ * Events are stored as binary_event_t records by default, which are also
+ * written in batches. For compatibility with older files, events can instead be
+ * stored with the message as a variable-length string, hex-encoded for
+ * standard midi messages (see set_event_format()).
+ *
+ * Sampled data are stored as floats by default, but channels can be converted
+ * to 16- or 24-bit integers (see set_sample_format()). The conversion is done
+ * in the writer thread, with optional dither, and the number of clipped samples
+ * is stored in the jill_clipped attribute of the dataset when the entry is
+ * closed. Integer datasets have a jill_scale attribute giving the value of one
+ * LSB in the original units. 24-bit samples are stored in 32-bit integers.
+ *
+ * The lossless formats convert samples to integers in the same way, and then
+ * compress them in chunks of chunk_frames samples with dsp::rice_codec, using a
+ * pool of encoder threads. The dataset for the channel holds the encoded chunks
+ * as a byte stream, and a second dataset (named in the jill_chunk_index
+ * attribute) gives the byte offset, first frame, and size of each chunk.
+ *
+ * The writer can also store overviews of sampled channels (see set_overview()),
+ * which give the min, max, and RMS of the signal in bins of increasing size, so
+ * that long recordings can be browsed without reading all the samples.
+ *
+ * Creating an entry and its datasets touches a lot of file metadata, so when
+ * the writer is flushed without an open entry, it creates the next entry and a
+ * dataset for each channel that was in the previous entry. new_entry() then
+ * only has to rename it and set the timing attributes, so entries are still
+ * numbered in the order they were started. The spare entry is removed when
+ * the writer is destroyed.
+ *
+ * The writer can be configured to roll over to a new file when the current one
+ * gets too large, has been open too long, or holds too many entries (see
+ * set_rollover()). Closing a large HDF5 file can take a while, so if the HDF5
+ * library is thread-safe, old files are closed on a background thread.
  */
 class arf_writer : public data_writer {
 public:
+        /** Storage formats for event datasets */
+        enum event_format_t { EVENT_BINARY, EVENT_HEX };
+
+        /** Storage formats for sampled datasets */
+        enum sample_format_t { SAMPLE_FLOAT, SAMPLE_INT16, SAMPLE_INT24,
+                               SAMPLE_LOSSLESS16, SAMPLE_LOSSLESS24 };
+
         /**
          * Initialize an ARF writer.
          *
@@ -32,6 +101,19 @@ public:
                    jill::data_source const & source,
                    std::map<std::string,std::string> const & entry_attrs,
                    int compression=0);
+
+        /**
+         * Initialize a writer that shares the file of another writer, so that
+         * several independent series of entries can be stored in the same
+         * file. Entries from all the writers are numbered in one sequence.
+         * Log messages are stored through @a parent.
+         *
+         * @param parent       the writer that owns the file
+         * @param entry_attrs  attributes to set on newly-created entries, in
+         *                     addition to the parent's
+         */
+        arf_writer(arf_writer const & parent,
+                   std::map<std::string,std::string> const & entry_attrs);
         ~arf_writer();
 
         /* data_writer overrides */
@@ -43,6 +125,81 @@ public:
         void log(timestamp_t const &, std::string const &, std::string const &);
         void flush();
 
+        /** The number of log messages to buffer before writing them to disk */
+        static const std::size_t log_batch_size = 256;
+
+        /** The number of events (per channel) to buffer before writing them to disk */
+        static const std::size_t event_batch_size = 256;
+
+        /**
+         * Set the storage format for event datasets. Only affects datasets
+         * created after the call.
+         */
+        void set_event_format(event_format_t fmt) { _event_format = fmt; }
+        event_format_t event_format() const { return _event_format; }
+
+        /**
+         * Set the storage format for sampled datasets. Only affects datasets
+         * created after the call.
+         */
+        void set_sample_format(sample_format_t fmt) { _sample_format = fmt; }
+
+        /** Set the storage format for sampled datasets of a specific channel */
+        void set_sample_format(std::string const & channel, sample_format_t fmt) {
+                _channel_formats[channel] = fmt;
+        }
+        sample_format_t sample_format(std::string const & channel) const;
+
+        /** Set whether to dither samples converted to integers */
+        void set_dither(bool dither) { _dither = dither; }
+
+        /** The number of frames in each chunk of losslessly compressed data */
+        static const std::size_t chunk_frames = 4096;
+
+        /**
+         * Set the number of threads used to encode lossless formats. Only
+         * takes effect before the first lossless dataset is written.
+         */
+        void set_encoder_threads(std::size_t n) { _encoder_threads = n; }
+
+        /** The number of overview records (per level) to buffer before writing */
+        static const std::size_t overview_batch_size = 64;
+
+        /**
+         * Store overviews of sampled channels. For each channel, nlevels
+         * datasets named <channel>_overview<N> are created, where N is the
+         * number of frames summarized by each record (base_frames, then
+         * multiplied by factor for each level). The records give the minimum,
+         * maximum, and RMS of the samples. Only affects entries created after
+         * the call.
+         *
+         * @param nlevels      the number of levels (0 to disable)
+         * @param base_frames  the size of the bins in the first level
+         * @param factor       the ratio between bin sizes of successive levels
+         */
+        void set_overview(std::size_t nlevels, std::size_t base_frames=256, std::size_t factor=16) {
+                _overview_levels = nlevels;
+                _overview_base = base_frames;
+                _overview_factor = factor;
+        }
+
+        /**
+         * Set conditions for starting a new file. When any of the limits is
+         * reached, the next entry is created in a new file, named by adding a
+         * serial number to the original file name (e.g. data_0001.arf). If an
+         * entry is open when a size or duration limit is reached, it is split
+         * at the next period boundary. Set a limit to 0 to disable it. The
+         * limits are shared with any writers created from this one.
+         *
+         * @param max_bytes    the maximum size of the file
+         * @param max_seconds  the maximum time to keep a file open
+         * @param max_entries  the maximum number of entries to create in a file
+         */
+        void set_rollover(boost::uint64_t max_bytes, double max_seconds, std::size_t max_entries);
+
+        /** The name of the file currently being written to */
+        std::string const & filename() const;
+
 protected:
         typedef std::map<std::string, arf::packet_table_ptr> dset_map_type;
 
@@ -56,20 +213,90 @@ protected:
         dset_map_type::iterator get_dataset(std::string const & name, bool is_sampled);
 
 private:
+        /* state shared by writers storing entries in the same file */
+        struct file_state;
+
+        /* open the current file in _state, and its log dataset */
+        void _open_file(std::string const & filename);
+        /* true if any of the rollover limits has been reached */
+        bool _rollover_due() const;
+        /* true if the size or duration limit has been reached (entries can be split) */
+        bool _file_limit_reached() const;
+        /* open the next file, passing the old one to the closing thread */
+        void _rollover();
         /* find last entry index */
         void _get_last_entry_index();
+        /* write buffered log messages to the log dataset */
+        void _flush_log();
+        /* write buffered binary events to their datasets */
+        void _flush_events();
+        /* the name for the next entry. Uses up an index */
+        std::string _next_entry_name();
+        /* create a new entry with the common attributes */
+        arf::entry_ptr _create_entry(std::string const & name);
+        /* create a dataset in entry for a channel */
+        arf::packet_table_ptr _create_dataset(arf::entry_ptr entry, std::string const & name,
+                                              bool is_sampled);
+        /* convert samples to an integer format and write them to dset */
+        template <typename Traits>
+        void _write_converted(dset_map_type::iterator dset, sample_t const * samples,
+                              std::size_t nframes);
+        /* convert samples to integers and queue them for encoding */
+        template <typename Traits>
+        void _write_encoded(dset_map_type::iterator dset, sample_t const * samples,
+                            std::size_t nframes);
+        /* write encoded chunks to their datasets. If wait, write all pending chunks */
+        void _write_chunks(bool wait);
+        /* add samples to the overview of a channel */
+        void _update_overview(std::string const & name, sample_t const * samples,
+                              std::size_t nframes);
+        /* write finished overview records to disk. If finish, include partial bins */
+        void _flush_overviews(bool finish);
+        /* create the next entry and its datasets ahead of time */
+        void _prepare_entry();
+        /* remove the spare entry from the file */
+        void _discard_prepared_entry();
 
         // references
         jill::data_source const & _data_source;
 
         // owned resources
-        arf::file_ptr _file;                       // output file
+        boost::shared_ptr<file_state> _state;      // output file (may be shared)
         std::map<std::string, std::string> _attrs; // attributes for new entries
-        arf::packet_table_ptr _log;                // log dataset
+        std::vector<std::string> _log_text;        // log messages waiting to be written
+        std::vector<std::pair<boost::int64_t, boost::int64_t> > _log_times;
         arf::entry_ptr _entry;                     // current entry (owned by thread)
         dset_map_type _dsets;                      // pointers to packet tables (owned)
         std::map<std::string, std::string> _dset_uuids; // session/channel uuid
+        std::map<std::string, bool> _dset_sampled; // channels in the last entry
+        arf::entry_ptr _next_entry;                // spare entry (see _prepare_entry)
+        arf::file_ptr _next_file;                  // file holding the spare entry
+        dset_map_type _next_dsets;                 // datasets in spare entry
         int _compression;                          // compression level for new datasets
+        event_format_t _event_format;              // storage format for new event datasets
+        sample_format_t _sample_format;            // default storage format for samples
+        std::map<std::string, sample_format_t> _channel_formats;
+        bool _dither;                              // dither converted samples
+        boost::uint32_t _dither_counter;           // state of dither generator
+        std::vector<char> _convert_buf;            // buffer for converted samples
+        std::map<std::string, boost::uint64_t> _clipped; // clipped samples in current entry
+        std::size_t _encoder_threads;              // threads for lossless encoding
+        boost::shared_ptr<dsp::chunk_encoder> _encoder; // created on demand
+        std::map<std::string, dsp::chunk_encoder::chunk *> _open_chunks; // being filled
+        dset_map_type _chunk_index;                // chunk index datasets, by channel
+        std::size_t _overview_levels;              // overview settings (see set_overview)
+        std::size_t _overview_base;
+        std::size_t _overview_factor;
+        // overviews of channels in the current entry, and their datasets
+        std::map<std::string, boost::shared_ptr<dsp::overview_pyramid> > _overviews;
+        std::map<std::string, std::vector<arf::packet_table_ptr> > _overview_dsets;
+        // byte offset and frame count of the next chunk, by channel
+        std::map<std::string, std::pair<boost::uint64_t, boost::uint64_t> > _chunk_pos;
+        // binary events waiting to be written, by channel
+        std::map<std::string, std::vector<binary_event_t> > _events;
+        // truncated binary events in current entry, and channels already warned about
+        std::map<std::string, boost::uint64_t> _truncated;
+        std::set<std::string> _truncation_warned;
 
         // these variables allow more precise timestamps; they are registered to
         // each other when set_data_source is called
@@ -80,7 +307,7 @@ private:
         nframes_t _entry_start;                    // offset sample counts
         nframes_t _last_frame;                     // last frame written to the
                                                    // current entry
-        std::size_t _entry_idx;                    // manage entry numbering
+        nframes_t _last_period;                    // time of the last sampled block
 
 };
 
@@ -12,6 +12,7 @@
 #ifndef _NULL_WRITER_HH
 #define _NULL_WRITER_HH
 
+#include <iostream>
 #include "../logging.hh"
 #include "../data_writer.hh"
 
@@ -19,12 +20,14 @@ namespace jill { namespace file {
 
 /**
  * A no-op implementation of jill::data_writer. This class prints useful log
- * messages but doesn't write any data. It's used primarily for testing.
+ * messages but doesn't write any data. It's used primarily for testing. If
+ * verbose is false, only entries are logged, not each block.
  */
 class null_writer : public data_writer {
 
 public:
-        null_writer() : _entry(0), _last_entry(0) {}
+        explicit null_writer(bool verbose=true)
+                : _verbose(verbose), _entry(0), _last_entry(0) {}
         void new_entry(nframes_t frame) {
                 _entry = ++_last_entry;
                 LOG << "new entry " << _entry << ", frame=" << frame;
@@ -40,12 +43,14 @@ public:
         bool aligned() const { return true; }
         void write(data_block_t const * data, nframes_t start, nframes_t stop) {
                 if (!_entry) new_entry(data->time);
+                if (!_verbose) return;
                 std::cout << "\rgot period: time=" << data->time << ", id=" << data->id()
                           << ", type=" << data->dtype << ", nframes=" << data->nframes()
                           << ", start=" << start << ", stop=" << stop << ' ' << std::flush;
         }
 
 private:
+        bool _verbose;
         int _entry;
         int _last_entry;
 };
@@ -27,18 +27,19 @@ stimfile::stimfile(std::string const & path)
 {
         _sndfile = sf_open(path.c_str(), SFM_READ, &_sfinfo);
         if (_sndfile == 0) throw jill::FileError(sf_strerror(_sndfile));
-        if (_sfinfo.channels != 1) {
-                throw jill::FileError("input file contains more than one channel");
+        if (_sfinfo.channels < 1) {
+                throw jill::FileError("input file contains no channels");
         }
         _nframes = _sfinfo.frames;
         _samplerate = _sfinfo.samplerate;
+        _nchannels = _sfinfo.channels;
 }
 
 stimfile::~stimfile()
 {
         if (_sndfile) sf_close(_sndfile);
 #if MLOCK_STIMFILES
-        if (_buffer) munlock(_buffer.get(), _nframes * sizeof(sample_t));
+        if (_buffer) munlock(_buffer.get(), _nframes * _nchannels * sizeof(sample_t));
 #endif
 }
 
@@ -56,22 +57,25 @@ stimfile::load_samples(nframes_t samplerate)
         }
 
         rs.input_frames = _sfinfo.frames;
-        buf = rs.data_in = new sample_t[rs.input_frames];
+        buf = rs.data_in = new sample_t[rs.input_frames * _nchannels];
 
         sf_seek(_sndfile, 0, SEEK_SET);
         // read file, ignoring any discrepancies in # of samples
-        _nframes = rs.input_frames = sf_read_float(_sndfile, buf, rs.input_frames);
+        _nframes = rs.input_frames = sf_readf_float(_sndfile, buf, rs.input_frames);
         _samplerate = _sfinfo.samplerate;
-        LOG << "read " << _nframes << " frames from " << _name << " at " << _samplerate;
+        LOG << "read " << _nframes << " frames (" << _nchannels << " channel(s)) from "
+            << _name << " at " << _samplerate;
 
         if ((samplerate > 0) && (samplerate != _samplerate)) {
                 rs.src_ratio = float(samplerate) / float(_samplerate);
                 rs.output_frames = (int)(rs.input_frames * rs.src_ratio);
-		rs.data_out = new sample_t[rs.output_frames];
+		rs.data_out = new sample_t[rs.output_frames * _nchannels];
                 LOG << "resampling " << _name << " to " << samplerate << " (" << rs.src_ratio << ") -> "
                     << rs.output_frames << " frames";
 
-                int ec = src_simple(&rs, SRC_SINC_BEST_QUALITY, 1);
+                // libsamplerate operates on interleaved frames, so all the
+                // channels are resampled in a single pass
+                int ec = src_simple(&rs, SRC_SINC_BEST_QUALITY, _nchannels);
                 delete[] rs.data_in;
 		if (ec != 0) {
                         delete[] rs.data_out;
@@ -83,8 +87,22 @@ stimfile::load_samples(nframes_t samplerate)
                 buf = rs.data_out;
         }
 
+        if (_nchannels > 1) {
+                // de-interleave so each channel is contiguous and can be
+                // copied to its port with a single memcpy
+                sample_t *planar = new sample_t[_nframes * _nchannels];
+                for (std::size_t c = 0; c < _nchannels; ++c) {
+                        sample_t *dst = planar + c * _nframes;
+                        sample_t const *src = buf + c;
+                        for (nframes_t i = 0; i < _nframes; ++i, src += _nchannels)
+                                dst[i] = *src;
+                }
+                delete[] buf;
+                buf = planar;
+        }
+
 #if MLOCK_STIMFILES
-        mlock(buf, _nframes * sizeof(sample_t));
+        mlock(buf, _nframes * _nchannels * sizeof(sample_t));
 #endif
         _buffer.reset(buf);
 
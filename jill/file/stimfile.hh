@@ -22,6 +22,8 @@ namespace jill { namespace file {
  * A stimulus stored on disk in a file. This implementation of stimulus_t uses
  * libsndfile to load the samples from disk, and libsamplerate to resample (if
  * needed). The loaded samples are stored in an array managed by the object.
+ * Multichannel files are de-interleaved when they are loaded, so that each
+ * channel occupies a contiguous block of the array.
  */
 class stimfile : public jill::stimulus_t {
 
@@ -40,8 +42,12 @@ public:
 
         nframes_t nframes() const { return _nframes; }
         nframes_t samplerate() const { return _samplerate; }
+        std::size_t nchannels() const { return _nchannels; }
 
         sample_t const * buffer() const { return (_buffer) ? _buffer.get() : 0; }
+        sample_t const * buffer(std::size_t chan) const {
+                return (_buffer && chan < _nchannels) ? _buffer.get() + chan * _nframes : 0;
+        }
 
         /**
          * Load samples from disk and resample as needed
@@ -57,6 +63,7 @@ private:
 
         nframes_t _nframes;
         nframes_t _samplerate;
+        std::size_t _nchannels;
 
         boost::scoped_array<sample_t> _buffer;
 };
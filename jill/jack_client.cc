@@ -15,27 +15,52 @@
 #include <jack/statistics.h>
 #include <jack/midiport.h>
 #include <cerrno>
+#include <csignal>
+#include <unistd.h>
 #include <algorithm>
 
 using namespace jill;
 using std::string;
 
+namespace {
+
+/* profiling interval for new clients; negative to disable */
+float default_profile_interval = -1;
+
+/* incremented by SIGUSR1 to request a profile report */
+volatile sig_atomic_t profile_requests = 0;
+
+void
+profile_signal_handler(int)
+{
+        profile_requests = profile_requests + 1;
+}
+
+} // anonymous namespace
+
 jack_client::jack_client(string const & name)
-        : _nports(0)
+        : _nports(0), _next_channel(0), _port_names_active(_port_names),
+          _port_name_readers(0), _cycle(1), _profile_interval(0), _profile_stop(0),
+          _profile_running(false)
 {
+        pthread_mutex_init(&_port_names_lock, 0);
         start_client(name.c_str(), 0);
         set_callbacks();
+        if (default_profile_interval >= 0) enable_profiling(default_profile_interval);
 }
 
 jack_client::jack_client(string const & name, string const & server)
-        : _nports(0)
+        : _nports(0), _next_channel(0), _port_names_active(_port_names),
+          _port_name_readers(0), _cycle(1), _profile_interval(0), _profile_stop(0),
+          _profile_running(false)
 {
+        pthread_mutex_init(&_port_names_lock, 0);
         if (!server.empty())
                 start_client(name.c_str(), server.c_str());
         else
                 start_client(name.c_str(), 0);
         set_callbacks();
-
+        if (default_profile_interval >= 0) enable_profiling(default_profile_interval);
 }
 
 jack_client::~jack_client()
@@ -43,6 +68,9 @@ jack_client::~jack_client()
 	if (_client) {
                 jack_client_close(_client);
         }
+        // the logger may already be gone (see deactivate), so don't log here
+        stop_profiling();
+        pthread_mutex_destroy(&_port_names_lock);
 }
 
 void
@@ -89,6 +117,20 @@ jack_client::register_port(string const & name, string const & type,
         }
         _ports.push_back(port);
         _nports += 1;
+        cache_port_name(jack_port_name(port), port);
+        cache_port_name(jack_port_short_name(port), port);
+
+        port_info info = { port, jack_port_short_name(port), _next_channel++, flags, 0 };
+        if (type == JACK_DEFAULT_MIDI_TYPE) {
+                if (flags & JackPortIsInput) {
+                        info.events = &_midi_cache[port];
+                        info.events->reserve(max_midi_events());
+                }
+                _midi_ports.push_back(info);
+        }
+        else if (type == JACK_DEFAULT_AUDIO_TYPE) {
+                _audio_ports.push_back(info);
+        }
         return port;
 }
 
@@ -107,6 +149,11 @@ jack_client::unregister_port(jack_port_t *port)
                                 << ret << ")");
         }
         _ports.remove(port);
+        cache_port_name(jack_port_name(port), 0);
+        cache_port_name(jack_port_short_name(port), 0);
+        remove_port(_audio_ports, port);
+        remove_port(_midi_ports, port);
+        _midi_cache.erase(port);
         _nports += -1;
         LOG << "port unregistered: " << jack_port_name(port) ;
 }
@@ -119,6 +166,7 @@ jack_client::activate()
                 throw JackError(util::make_string() << "unable to activate client (err="
                                 << ret << ")");
         }
+        if (_profiler) start_profiling();
         LOG << "activated client (load=" << jack_cpu_load(_client) << "%)" ;
 }
 
@@ -131,6 +179,82 @@ jack_client::deactivate()
                                 << ret << ")");
         }
         LOG << "deactivated client" ;
+        // modules keep the client in a static pointer that outlives the
+        // logger, so the final statistics are logged here
+        stop_profiling();
+        log_profile();
+}
+
+void
+jack_client::enable_profiling(float interval)
+{
+        if (_profiler) return;
+        _profiler.reset(new load_profiler);
+        _profile_interval = interval;
+        signal(SIGUSR1, profile_signal_handler);
+        try {
+                start_profiling();
+        }
+        catch (JackError const &) {
+                _profiler.reset();
+                throw;
+        }
+        LOG << "profiling process callback (send SIGUSR1 for statistics)";
+}
+
+void
+jack_client::start_profiling()
+{
+        if (_profile_running) return;
+        _profile_stop = 0;
+        if (pthread_create(&_profile_thread, 0, profile_thread, this) != 0)
+                throw JackError("unable to start profiler thread");
+        _profile_running = true;
+}
+
+void
+jack_client::stop_profiling()
+{
+        if (!_profile_running) return;
+        __sync_add_and_fetch(&_profile_stop, 1);
+        pthread_join(_profile_thread, 0);
+        _profile_running = false;
+}
+
+void
+jack_client::log_profile()
+{
+        if (!_profiler) return;
+        load_profiler::stats s = _profiler->get();
+        _profiler->reset();
+        if (s.count == 0) return;
+        LOG << "process load (" << s.count << " cycles): p50=" << s.p50 * 100
+            << "% p99=" << s.p99 * 100 << "% max=" << s.max * 100 << "%";
+}
+
+void
+jack_client::set_default_profiling(float interval)
+{
+        default_profile_interval = interval;
+}
+
+void *
+jack_client::profile_thread(void * arg)
+{
+        jack_client * self = static_cast<jack_client*>(arg);
+        sig_atomic_t requests = profile_requests;
+        float elapsed = 0;
+        while (!__sync_add_and_fetch(&self->_profile_stop, 0)) {
+                usleep(100000);
+                elapsed += 0.1;
+                if (profile_requests != requests ||
+                    (self->_profile_interval > 0 && elapsed >= self->_profile_interval)) {
+                        requests = profile_requests;
+                        elapsed = 0;
+                        self->log_profile();
+                }
+        }
+        return 0;
 }
 
 void
@@ -185,7 +309,16 @@ jack_client::disconnect_all()
 sample_t*
 jack_client::samples(string const & name, nframes_t nframes)
 {
-        return samples(jack_port_by_name(_client, name.c_str()), nframes);
+        jack_port_t *port = 0;
+        // the counter keeps the writer from modifying the active copy
+        __sync_add_and_fetch(&_port_name_readers, 1);
+        port_name_map const * names = _port_names_active;
+        port_name_map::const_iterator it = names->find(name);
+        if (it != names->end()) port = it->second;
+        __sync_add_and_fetch(&_port_name_readers, -1);
+        if (port == 0)
+                port = jack_port_by_name(_client, name.c_str());
+        return samples(port, nframes);
 }
 
 
@@ -211,6 +344,69 @@ jack_client::events(jack_port_t *port, nframes_t nframes)
                 return 0;
 }
 
+midi_event_cache const *
+jack_client::midi_events(jack_port_t *port, nframes_t nframes)
+{
+        std::map<jack_port_t*, midi_event_cache>::iterator it = _midi_cache.find(port);
+        if (it == _midi_cache.end()) return 0;
+        return fill_events(port, it->second, nframes);
+}
+
+midi_event_cache const *
+jack_client::midi_events(port_info const & port, nframes_t nframes)
+{
+        if (port.events == 0) return 0;
+        return fill_events(port.port, *port.events, nframes);
+}
+
+midi_event_cache const *
+jack_client::fill_events(jack_port_t *port, midi_event_cache & cache, nframes_t nframes)
+{
+        if (cache.cycle() != _cycle) {
+                cache.fill(jack_port_get_buffer(port, nframes));
+                cache.set_cycle(_cycle);
+        }
+        return &cache;
+}
+
+void
+jack_client::cache_port_name(string const & name, jack_port_t *port)
+{
+        pthread_mutex_lock(&_port_names_lock);
+        port_name_map * active = _port_names_active;
+        port_name_map * inactive = (active == _port_names) ? _port_names + 1 : _port_names;
+        *inactive = *active;
+        if (port)
+                (*inactive)[name] = port;
+        else
+                inactive->erase(name);
+        // the map has to be complete before readers can see it
+        __sync_synchronize();
+        _port_names_active = inactive;
+        // wait for readers that may have picked up the old copy
+        while (__sync_add_and_fetch(&_port_name_readers, 0) > 0)
+                usleep(100);
+        pthread_mutex_unlock(&_port_names_lock);
+}
+
+void
+jack_client::remove_port(port_table_type & table, jack_port_t *port)
+{
+        for (port_table_type::iterator it = table.begin(); it != table.end(); ++it) {
+                if (it->port == port) {
+                        table.erase(it);
+                        return;
+                }
+        }
+}
+
+std::size_t
+jack_client::max_midi_events() const
+{
+        // every event in a jack midi buffer takes at least 8 bytes
+        return jack_port_type_get_buffer_size(_client, JACK_DEFAULT_MIDI_TYPE) / 8;
+}
+
 jack_port_t*
 jack_client::get_port(string const & name) const
 {
@@ -272,7 +468,16 @@ jack_client::process_callback_(nframes_t nframes, void *arg)
 {
 	jack_client *self = static_cast<jack_client*>(arg);
         nframes_t time = jack_last_frame_time(self->_client);
-	return (self->_process_cb) ? self->_process_cb(self, nframes, time) : 0;
+        self->_cycle += 1;
+        if (!self->_profiler)
+                return (self->_process_cb) ? self->_process_cb(self, nframes, time) : 0;
+
+        timespec t0, t1;
+        load_profiler::now(t0);
+	int ret = (self->_process_cb) ? self->_process_cb(self, nframes, time) : 0;
+        load_profiler::now(t1);
+        self->_profiler->record(t0, t1, 1e9 * nframes / jack_get_sample_rate(self->_client));
+        return ret;
 }
 
 void
@@ -280,7 +485,11 @@ jack_client::portreg_callback_(jack_port_id_t id, int registered, void *arg)
 {
 	jack_client *self = static_cast<jack_client*>(arg);
         jack_port_t *port = jack_port_by_id(self->_client, id);
-        if (!jack_port_is_mine(self->_client, port)) return;
+        if (!jack_port_is_mine(self->_client, port)) {
+                // a cached handle for a port that's going away would dangle
+                if (!registered) self->cache_port_name(jack_port_name(port), 0);
+                return;
+        }
         LOG << "port registered: " << jack_port_name(port)
               << " (" << jack_port_type(port) << ")" ;
         if (self->_portreg_cb)
@@ -300,6 +509,15 @@ jack_client::portconn_callback_(jack_port_id_t a, jack_port_id_t b, int connecte
         LOG << "ports " << ((connected) ? "" : "dis") << "connected: "
                     << jack_port_name(port1) << " -> " << jack_port_name(port2) ;
 
+        // cache handles for the ports on the other end of connections. The
+        // entry is dropped on any disconnect, because later disconnects from
+        // other clients aren't seen here; samples() will look the port up
+        for (int i = 0; i < 2; ++i) {
+                jack_port_t *port = (i == 0) ? port1 : port2;
+                if (jack_port_is_mine(self->_client, port)) continue;
+                self->cache_port_name(jack_port_name(port), connected ? port : 0);
+        }
+
         if (self->_portconn_cb) {
                 self->_portconn_cb(self, port1, port2, connected);
         }
@@ -318,6 +536,12 @@ jack_client::buffer_size_callback_(nframes_t nframes, void *arg)
 {
 	jack_client *self = static_cast<jack_client*>(arg);
         LOG << "period size (frames): " << nframes ;
+        // midi buffers scale with the period size
+        std::size_t nevents = self->max_midi_events();
+        std::map<jack_port_t*, midi_event_cache>::iterator it;
+        for (it = self->_midi_cache.begin(); it != self->_midi_cache.end(); ++it) {
+                it->second.reserve(nevents);
+        }
 	return (self->_buffer_size_cb) ? self->_buffer_size_cb(self, nframes) : 0;
 }
 
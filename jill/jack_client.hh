@@ -14,10 +14,16 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
+#include <pthread.h>
 #include <boost/noncopyable.hpp>
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <jack/jack.h>
 #include "data_source.hh"
+#include "midi.hh"
+#include "load_profiler.hh"
 
 /**
  * @defgroup clientgroup Creating and controlling JACK clients
@@ -90,6 +96,19 @@ public:
 
         typedef std::list<jack_port_t*> port_list_type;
 
+        /**
+         * Information about a registered port, looked up when the port is
+         * registered so that the process callback doesn't have to.
+         */
+        struct port_info {
+                jack_port_t * port;
+                std::string name;               // short name
+                std::size_t channel;            // unique id, in order of registration
+                unsigned long flags;
+                midi_event_cache * events;      // decoded events, for midi inputs
+        };
+        typedef std::vector<port_info> port_table_type;
+
 	/**
 	 * Initialize a new JACK client. All clients are identified to the JACK
 	 * server by an alphanumeric name, which is specified here. Creates the
@@ -153,9 +172,33 @@ public:
         /** Activate the client. Do this before attempting to connect ports */
         void activate();
 
-        /** Deactivate the client. Disconnects all ports */
+        /**
+         * Deactivate the client. Disconnects all ports. If profiling is
+         * enabled, stops logging statistics and logs them one last time.
+         */
         void deactivate();
 
+        /**
+         * Start timing the process callback. The duration of each cycle is
+         * recorded as a fraction of the period, and the median, 99th
+         * percentile, and maximum are logged every @a interval seconds (if
+         * nonzero) and whenever the process receives SIGUSR1. Call before
+         * activating the client.
+         *
+         * Clients created after set_default_profiling() is called (e.g. with
+         * the --profile option) are profiled automatically.
+         */
+        void enable_profiling(float interval=0);
+
+        /** The process callback profiler, or 0 if profiling is not enabled */
+        load_profiler const * profiler() const { return _profiler.get(); }
+
+        /** Log the process callback statistics and reset the histogram */
+        void log_profile();
+
+        /** Profile all subsequently created clients. A negative interval disables. */
+        static void set_default_profiling(float interval);
+
 	/**
 	 * Connect one the client's ports to another port. Fails silently if the
 	 * ports are already connected.
@@ -183,13 +226,32 @@ public:
 	/** Disconnect the client from all its ports. */
 	void disconnect_all();
 
-        /** Get sample buffer for port */
+        /**
+         * Get sample buffer for port. Ports owned by the client (by short or
+         * full name) and the ports connected to them are looked up in a
+         * cache, so this is realtime safe for those ports. Any other name,
+         * including a port that has been disconnected from one of ours,
+         * requires a query to the server, which is not.
+         */
         sample_t * samples(std::string const & name, nframes_t nframes);
         sample_t * samples(jack_port_t *port, nframes_t nframes);
 
         /** Get event buffer for port. If the port is an output port it's cleared. */
         void * events(jack_port_t *port, nframes_t);
 
+        /**
+         * Get the decoded events in a MIDI input port for the current cycle.
+         * The port buffer is decoded the first time this is called in each
+         * cycle, and subsequent calls return the same cache, so any number of
+         * consumers can examine the events without decoding them again.
+         * Realtime safe; call only from the process callback.
+         *
+         * @return the events, or 0 if the port is not a MIDI input registered
+         *         through this object
+         */
+        midi_event_cache const * midi_events(jack_port_t *port, nframes_t nframes);
+        midi_event_cache const * midi_events(port_info const & port, nframes_t nframes);
+
 	/* -- Inspect state of the client or server -- */
 
         /** Return the underlying JACK client object */
@@ -199,6 +261,14 @@ public:
         port_list_type const & ports() const { return _ports;}
         std::size_t nports() const { return _nports; }
 
+        /**
+         * Audio and MIDI ports registered through this object, in order of
+         * registration. Iterating through these tables in the process callback
+         * is faster than inspecting each port in ports(). Realtime safe.
+         */
+        port_table_type const & audio_ports() const { return _audio_ports; }
+        port_table_type const & midi_ports() const { return _midi_ports; }
+
         /**
          * Look up a jack port by name. The port doesn't have to be owned by the
          * client. Not RT safe.
@@ -224,6 +294,32 @@ protected:
         /** Ports owned by this client */
         port_list_type _ports;
         std::size_t _nports;
+        /** Decoded events for MIDI input ports */
+        std::map<jack_port_t*, midi_event_cache> _midi_cache;
+        /** Ports by type */
+        port_table_type _audio_ports;
+        port_table_type _midi_ports;
+        /** The channel id for the next registered port */
+        std::size_t _next_channel;
+        /**
+         * Port handles by name. Lookups may happen in the process thread
+         * while the cache is being updated, so there are two copies. Updates
+         * are made to the inactive copy, which is then swapped in after any
+         * readers of the old copy are finished.
+         */
+        typedef std::map<std::string, jack_port_t*> port_name_map;
+        port_name_map _port_names[2];
+        port_name_map * volatile _port_names_active;
+        int _port_name_readers;
+        pthread_mutex_t _port_names_lock; // serializes updates
+        /** Counts process cycles, to determine when caches are stale */
+        unsigned long _cycle;
+        /** Times the process callback, if enabled */
+        boost::scoped_ptr<load_profiler> _profiler;
+        float _profile_interval;
+        pthread_t _profile_thread;
+        int _profile_stop;
+        bool _profile_running;
 
 private:
 	jack_client_t * _client; // pointer to jack client
@@ -238,6 +334,19 @@ private:
 
         void start_client(char const * name, char const * server_name=0);
         void set_callbacks();
+        /* the largest number of events a midi buffer can hold */
+        std::size_t max_midi_events() const;
+        /* decode events into the cache if it's stale */
+        midi_event_cache const * fill_events(jack_port_t *port, midi_event_cache & cache,
+                                             nframes_t nframes);
+        static void remove_port(port_table_type & table, jack_port_t *port);
+        /* add a name (or remove it, if port is 0) to the name cache. Not RT safe */
+        void cache_port_name(std::string const & name, jack_port_t *port);
+        /* start or stop the thread that logs profiler statistics */
+        void start_profiling();
+        void stop_profiling();
+        /* logs profiler statistics when requested */
+        static void * profile_thread(void *);
 
         /* static callback functions actually registered with JACK server */
 	static int process_callback_(nframes_t, void *);
@@ -0,0 +1,107 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _LOAD_PROFILER_HH
+#define _LOAD_PROFILER_HH
+
+#include <cstring>
+#include <algorithm>
+#include <time.h>
+#include <boost/noncopyable.hpp>
+
+namespace jill {
+
+/**
+ * @ingroup miscgroup
+ * @brief histogram of the time the process callback takes
+ *
+ * Records the duration of each process cycle as a fraction of the period
+ * (i.e., the DSP load), in a histogram with fixed bins so that record() is
+ * lock-free and realtime safe. Statistics can be read from another thread at
+ * any time; they may be off by a cycle or two if a cycle is being recorded.
+ */
+class load_profiler : boost::noncopyable {
+public:
+        /** The number of bins between 0 and 100% load. Higher loads share a bin. */
+        static const unsigned int nbins = 200;
+
+        struct stats {
+                unsigned long count;    // the number of cycles
+                double p50;             // median load (fraction of the period)
+                double p99;             // 99th percentile
+                double max;             // maximum load
+        };
+
+        load_profiler() { reset(); }
+
+        /** Record the load for one cycle. Realtime safe. */
+        void record(double load) {
+                if (load < 0) load = 0;
+                unsigned int bin = (load >= 1.0) ? nbins : (unsigned int)(load * nbins);
+                __sync_add_and_fetch(&_bins[bin], 1);
+                __sync_add_and_fetch(&_count, 1);
+                unsigned int ppm = (load > 4000.0) ? 4000000000U : (unsigned int)(load * 1e6);
+                unsigned int old = _max_ppm;
+                while (ppm > old) {
+                        unsigned int prev = __sync_val_compare_and_swap(&_max_ppm, old, ppm);
+                        if (prev == old) break;
+                        old = prev;
+                }
+        }
+
+        /** Record the load for a cycle that started at t0 and ended at t1 */
+        void record(timespec const & t0, timespec const & t1, double period_ns) {
+                double elapsed = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+                record(elapsed / period_ns);
+        }
+
+        /** Compute statistics. Percentiles are resolved to the bin width. */
+        stats get() const {
+                stats out = { _count, 0.0, 0.0, _max_ppm * 1e-6 };
+                out.p50 = percentile(0.5);
+                out.p99 = percentile(0.99);
+                return out;
+        }
+
+        /** Clear the histogram */
+        void reset() {
+                memset((void*)_bins, 0, sizeof(_bins));
+                _count = 0;
+                _max_ppm = 0;
+        }
+
+        /** The current time from the monotonic clock */
+        static void now(timespec & t) {
+                clock_gettime(CLOCK_MONOTONIC, &t);
+        }
+
+private:
+        /* the upper edge of the bin containing the qth quantile */
+        double percentile(double q) const {
+                unsigned long target = (unsigned long)(q * _count + 0.5);
+                if (_count == 0) return 0.0;
+                if (target < 1) target = 1;
+                unsigned long cum = 0;
+                for (unsigned int i = 0; i < nbins; ++i) {
+                        cum += _bins[i];
+                        if (cum >= target)
+                                return std::min(double(i + 1) / nbins, _max_ppm * 1e-6);
+                }
+                return _max_ppm * 1e-6;
+        }
+
+        unsigned long volatile _bins[nbins + 1];
+        unsigned long volatile _count;
+        unsigned int volatile _max_ppm;         // maximum load, in parts per million
+};
+
+} // namespace jill
+
+#endif
@@ -14,40 +14,66 @@
 #include "zmq.hh"
 #include <sstream>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <time.h>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 using namespace boost::posix_time;
 using namespace jill;
 
+static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+
 log_msg::log_msg()
-        : _creation(microsec_clock::universal_time())
-{}
+        : _buf(_record.msg, JILL_LOG_MSG_SIZE), _stream(&_buf)
+{
+        // clock_gettime is realtime safe, unlike microsec_clock
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        _record.usec = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
 log_msg::log_msg(timestamp_t const & utc)
-        : _creation(utc)
-{}
+        : _buf(_record.msg, JILL_LOG_MSG_SIZE), _stream(&_buf)
+{
+        _record.usec = (utc - epoch).total_microseconds();
+}
 
 log_msg::~log_msg()
 {
-        logger::instance().log(_creation, _stream.str());
+        _record.size = _buf.size();
+        logger::instance().log(_record);
 }
 
 logger::logger()
         // initialize zmq context and socket. Use a dealer socket because log
         // messages are asynchronous (no response from recipient).
         : _context(zmq_init(1)), _socket(zmq_socket(_context, ZMQ_DEALER)),
-          _connected(false)
+          _connected(false), _queue(new slot_t[queue_size]),
+          _enqueue_pos(0), _dequeue_pos(0), _dropped(0), _dropped_total(0),
+          _running(1), _batch_count(0)
 {
         pthread_mutex_init(&_lock, 0);
+        for (std::size_t i = 0; i < queue_size; ++i)
+                _queue[i].seq = i;
+        _batch.reserve(max_batch_bytes + sizeof(log_record) + 256);
+        sem_init(&_pending, 0, 0);
+        pthread_create(&_thread_id, NULL, logger::thread, this);
 }
 
 logger::~logger()
 {
         // note: this object may be destroyed before other objects, so it's
-        // generally not a good idea to log in destructors
+        // generally not a good idea to log in destructors. Any messages still
+        // in the queue are written before the thread exits, and later
+        // messages are dropped. The queue and semaphore are not freed, so a
+        // message that races with shutdown still has somewhere to go.
+        __sync_lock_test_and_set(&_running, 0);
+        sem_post(&_pending);
+        pthread_join(_thread_id, NULL);
+
         _connected = false;
-        DBG << "cleaning up logger";
         // wait 1 s for server to handle any queued messages, then close the
         // socket and context
         int linger = 1000;
@@ -57,31 +83,142 @@ logger::~logger()
         pthread_mutex_destroy(&_lock);
 }
 
+/*
+ * The queue is a bounded multi-producer/single-consumer array. Each slot has a
+ * sequence number; a producer may claim the slot at position pos when seq ==
+ * pos, and the consumer may read it when seq == pos + 1. The consumer then sets
+ * seq to pos + queue_size to hand the slot back to the producers.
+ */
+void
+logger::log(log_record const & record)
+{
+        // the logger is being destroyed
+        if (!_running) return;
+        slot_t * slot;
+        std::size_t pos = _enqueue_pos;
+        for (;;) {
+                slot = _queue + (pos & (queue_size - 1));
+                std::size_t seq = slot->seq;
+                __sync_synchronize();
+                long dif = (long)seq - (long)pos;
+                if (dif == 0) {
+                        if (__sync_bool_compare_and_swap(&_enqueue_pos, pos, pos + 1))
+                                break;
+                        pos = _enqueue_pos;
+                }
+                else if (dif < 0) {
+                        // queue is full
+                        __sync_add_and_fetch(&_dropped, 1);
+                        __sync_add_and_fetch(&_dropped_total, 1);
+                        return;
+                }
+                else {
+                        pos = _enqueue_pos;
+                }
+        }
+        slot->record.usec = record.usec;
+        slot->record.size = std::min<std::size_t>(record.size, JILL_LOG_MSG_SIZE);
+        memcpy(slot->record.msg, record.msg, slot->record.size);
+        __sync_synchronize();
+        slot->seq = pos + 1;
+        sem_post(&_pending);
+}
+
 void
 logger::log(timestamp_t const & utc, std::string const & msg)
+{
+        log_record record;
+        record.usec = (utc - epoch).total_microseconds();
+        record.size = msg.copy(record.msg, JILL_LOG_MSG_SIZE);
+        log(record);
+}
+
+bool
+logger::pop(log_record & record)
+{
+        slot_t * slot = _queue + (_dequeue_pos & (queue_size - 1));
+        std::size_t seq = slot->seq;
+        __sync_synchronize();
+        if ((long)seq - (long)(_dequeue_pos + 1) < 0)
+                return false;
+        record.usec = slot->record.usec;
+        record.size = slot->record.size;
+        memcpy(record.msg, slot->record.msg, record.size);
+        __sync_synchronize();
+        slot->seq = _dequeue_pos + queue_size;
+        ++_dequeue_pos;
+        return true;
+}
+
+void
+logger::write(log_record const & record)
 {
         typedef boost::date_time::c_local_adjustor<timestamp_t> local_adj;
+        timestamp_t utc = epoch + microseconds(record.usec);
         timestamp_t local = local_adj::utc_to_local(utc);
-        // printf calls are generally threadsafe
-        printf("%s [%s] %s\n", to_iso_string(local).c_str(), _source.c_str(), msg.c_str());
 
+        printf("%s [%s] %.*s\n", to_iso_string(local).c_str(), _source.c_str(),
+               (int)record.size, record.msg);
         if (_connected) {
-                pthread_mutex_lock(&_lock);
-                // message consists of the source name, the timestamp (as an iso
-                // string), and the actual log message. Note that the zmq dealer socket
-                // doesn't prepend an address envelope, so this is what the recipient
-                // router socket will see
-                zmq::send(_socket, _source, ZMQ_SNDMORE);
-                zmq::send(_socket, to_iso_string(utc), ZMQ_SNDMORE);
-                zmq::send(_socket, msg);
-                pthread_mutex_unlock(&_lock);
+                zmq::log_batch_append(_batch, record.usec, record.msg, record.size);
+                _batch_count += 1;
+                if (_batch.size() >= max_batch_bytes) send_batch();
         }
 }
 
+void
+logger::send_batch()
+{
+        if (_batch_count > 0) {
+                // the zmq dealer socket doesn't prepend an address envelope, so
+                // the recipient router socket will see just the batch
+                zmq::send(_socket, _batch);
+        }
+        zmq::log_batch_init(_batch, _source);
+        _batch_count = 0;
+}
+
+void *
+logger::thread(void * arg)
+{
+        logger * self = static_cast<logger *>(arg);
+        log_record record;
+        for (;;) {
+                sem_wait(&self->_pending);
+                pthread_mutex_lock(&self->_lock);
+                zmq::log_batch_init(self->_batch, self->_source);
+                self->_batch_count = 0;
+                while (self->pop(record)) {
+                        self->write(record);
+                }
+                unsigned long dropped = __sync_fetch_and_and(&self->_dropped, 0);
+                if (dropped > 0) {
+                        // written directly, because the queue may still be full
+                        record.usec = (microsec_clock::universal_time() - epoch).total_microseconds();
+                        record.size = snprintf(record.msg, JILL_LOG_MSG_SIZE,
+                                               "WARNING: log queue full; dropped %lu messages",
+                                               dropped);
+                        self->write(record);
+                }
+                if (!self->_running) {
+                        // final drain
+                        while (self->pop(record)) self->write(record);
+                        self->send_batch();
+                        pthread_mutex_unlock(&self->_lock);
+                        break;
+                }
+                self->send_batch();
+                pthread_mutex_unlock(&self->_lock);
+        }
+        return 0;
+}
+
 void
 logger::set_sourcename(std::string const & name)
 {
+        pthread_mutex_lock(&_lock);
         _source = name;
+        pthread_mutex_unlock(&_lock);
 }
 
 void
@@ -95,12 +232,14 @@ logger::connect(std::string const & server_name)
         // and be transmitted when it does.
         std::ostringstream endpoint;
         endpoint << "ipc:///tmp/org.meliza.jill/" << server_name << "/msg";
-        if (zmq_connect(_socket, endpoint.str().c_str()) != 0) {
+        pthread_mutex_lock(&_lock);
+        int rc = zmq_connect(_socket, endpoint.str().c_str());
+        _connected = (rc == 0);
+        pthread_mutex_unlock(&_lock);
+        if (rc != 0) {
                 LOG << "error connecting to endpoint " << endpoint.str();
         }
         else {
                 INFO << "logging to " << endpoint.str();
-                _connected = true;
         }
 }
-
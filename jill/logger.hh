@@ -12,8 +12,11 @@
 #ifndef _LOGGER_HH
 #define _LOGGER_HH
 
+#include <string>
 #include <boost/noncopyable.hpp>
 #include <pthread.h>
+#include <semaphore.h>
+#include "logging.hh"
 
 namespace jill {
 
@@ -23,6 +26,12 @@ namespace jill {
  * have to interact with this directly except to set the source name, which is
  * used in formatting log messages, and to connect to the external logger.
  *
+ * Messages are passed through a bounded lock-free queue to a background thread
+ * that formats the timestamps and does all the output, so log() never blocks.
+ * If the queue is full, the message is dropped and counted; the background
+ * thread reports the number of dropped messages. All the messages that are
+ * waiting when the thread wakes are sent to the socket as a single batch.
+ *
  * This class is a singleton and can only be accessed through instance()
  */
 class logger : boost::noncopyable {
@@ -35,7 +44,13 @@ public:
                 return _instance;
         }
 
-        /** Log a timestamped message */
+        /**
+         * Queue a log record for output. Realtime safe (does not lock or
+         * allocate), and may be called from any thread.
+         */
+        void log(log_record const & record);
+
+        /** Log a timestamped message. Messages longer than JILL_LOG_MSG_SIZE are truncated */
         void log(timestamp_t const & utc, std::string const & msg);
 
         /**
@@ -57,15 +72,49 @@ public:
          */
         void connect(std::string const & server_name);
 
+        /** The total number of messages dropped because the queue was full */
+        unsigned long dropped() const { return _dropped_total; }
+
+        /** The number of records the queue can hold */
+        static const std::size_t queue_size = 256;
+
 private:
         logger();
         ~logger();
 
+        /* slot in the message queue. seq coordinates producers and consumer */
+        struct slot_t {
+                std::size_t volatile seq;
+                log_record record;
+        };
+
+        /* take the next record off the queue; returns false if empty */
+        bool pop(log_record & record);
+        /* format and output a record; called by background thread */
+        void write(log_record const & record);
+        /* send the current batch to the socket and start a new one */
+        void send_batch();
+        static void * thread(void * arg);
+
         std::string _source;
-        pthread_mutex_t _lock;  // mutex for zmq socket access
+        pthread_mutex_t _lock;  // mutex for zmq socket and source name access
         void * _context;        // zmq context
         void * _socket;         // zmq socket
         bool _connected;        // was connection successful?
+
+        slot_t * _queue;
+        std::size_t volatile _enqueue_pos;
+        std::size_t _dequeue_pos;
+        unsigned long volatile _dropped;        // dropped since last report
+        unsigned long volatile _dropped_total;
+        sem_t _pending;
+        pthread_t _thread_id;
+        int volatile _running;
+
+        // messages are sent to the socket in batches (see zmq::log_batch_init)
+        static const std::size_t max_batch_bytes = 32768;
+        std::string _batch;
+        int _batch_count;
 };
 
 }
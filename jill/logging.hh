@@ -13,8 +13,10 @@
 #define _LOGGING_HH
 
 #include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
-#include <iosfwd>
+#include <streambuf>
+#include <ostream>
 
 #ifndef DEBUG
 #define DEBUG 0
@@ -27,11 +29,39 @@
         if (DEBUG < 2) ; \
         else log_msg() << "D: "
 
+/** The maximum length of a log message. Longer messages are truncated. */
+#define JILL_LOG_MSG_SIZE 500
+
 namespace jill {
 
 /** Define timestamp type */
 typedef boost::posix_time::ptime timestamp_t;
 
+/**
+ * A log message and its time of creation. This is the unit passed from
+ * log_msg to the logger's background thread.
+ */
+struct log_record {
+        boost::int64_t usec;              // microseconds since the epoch (utc)
+        std::size_t size;                 // number of bytes in msg
+        char msg[JILL_LOG_MSG_SIZE];      // not null-terminated
+};
+
+namespace detail {
+
+/** A streambuf that writes to a fixed array, discarding anything that doesn't fit */
+class fixed_streambuf : public std::streambuf {
+public:
+        fixed_streambuf(char * buf, std::size_t size) {
+                setp(buf, buf + size);
+        }
+        std::size_t size() const { return pptr() - pbase(); }
+protected:
+        int_type overflow(int_type) { return traits_type::eof(); }
+};
+
+}
+
 /**
  * Simple atomic logging class with stream support.
  *
@@ -41,6 +71,10 @@ typedef boost::posix_time::ptime timestamp_t;
  * This example creates a message that can be constructed with stream operators
  * and that will be written on destruction (here, at the end of the statement).
  *
+ * The message is formatted into a fixed-size record on the stack of the calling
+ * thread and handed to the logger without locking or allocating memory, so it's
+ * safe to log from the process callback. Writing the message to the console and
+ * to the log socket happens in the logger's own thread.
  */
 class log_msg : boost::noncopyable {
 
@@ -61,8 +95,9 @@ public:
         }
 
 private:
-        timestamp_t _creation;    // in utc
-        std::ostringstream _stream;
+        log_record _record;
+        detail::fixed_streambuf _buf;
+        std::ostream _stream;
 };
 
 }
@@ -14,6 +14,7 @@
 #include "types.hh"
 #include <errno.h>
 #include <string>
+#include <vector>
 #include <cstring>
 #include <jack/midiport.h>
 
@@ -48,6 +49,14 @@ struct midi {
         const static data_type default_pitch = 60;
         const static data_type default_velocity = 64;
 
+        /** A decoded event. The data pointer is valid for the current cycle only. */
+        struct event_t {
+                nframes_t time;                 // offset in the period
+                data_type status;               // first byte, or 0 for empty events
+                std::size_t size;               // size of the message, including status
+                data_type const * buffer;       // the message
+        };
+
         /**
          * Write a string message to a midi buffer.  This is inlined for speed.
          *
@@ -94,6 +103,15 @@ struct midi {
                 return -1;
         }
 
+        /** Is the status byte of the event an onset or an offset */
+        static bool is_onset(event_t const & e) {
+                return is_onset(e.buffer, e.size);
+        }
+
+        static bool is_offset(event_t const & e) {
+                return is_offset(e.buffer, e.size);
+        }
+
         static bool is_onset(void const * buffer, std::size_t size) {
                 if (size == 0) return false;
                 data_type t = *reinterpret_cast<data_type const *>(buffer) & type_nib;
@@ -108,6 +126,95 @@ struct midi {
 
 };
 
+/**
+ * @brief the decoded contents of a MIDI buffer
+ *
+ * Stores the time, status, and size of each event in a JACK midi buffer in a
+ * flat array, so that the buffer only has to be decoded once per cycle no
+ * matter how many consumers examine it. Storage is allocated with reserve(),
+ * after which fill() is realtime safe. Events beyond the reserved capacity are
+ * counted but not stored.
+ */
+class midi_event_cache {
+public:
+        typedef std::vector<midi::event_t>::const_iterator const_iterator;
+
+        midi_event_cache() : _nevents(0), _dropped(0), _cycle(0) {}
+
+        /** Allocate storage for n events. Not realtime safe. */
+        void reserve(std::size_t n) {
+                if (n > _events.size()) _events.resize(n);
+        }
+
+        /** Decode the events in a buffer, replacing the cache's contents */
+        void fill(void * buffer) {
+                jack_midi_event_t event;
+                nframes_t nevents = (buffer) ? jack_midi_get_event_count(buffer) : 0;
+                _nevents = 0;
+                for (nframes_t i = 0; i < nevents; ++i) {
+                        if (_nevents == _events.size()) {
+                                _dropped += nevents - i;
+                                break;
+                        }
+                        if (jack_midi_event_get(&event, buffer, i) != 0) continue;
+                        midi::event_t & e = _events[_nevents++];
+                        e.time = event.time;
+                        e.size = event.size;
+                        e.status = (event.size > 0) ? event.buffer[0] : 0;
+                        e.buffer = event.buffer;
+                }
+        }
+
+        std::size_t size() const { return _nevents; }
+        bool empty() const { return _nevents == 0; }
+        midi::event_t const & operator[](std::size_t i) const { return _events[i]; }
+        const_iterator begin() const { return _events.begin(); }
+        const_iterator end() const { return _events.begin() + _nevents; }
+
+        /**
+         * Find the next non-empty event of a given type
+         *
+         * @param type  the type of the event (the high nibble of the status byte)
+         * @param from  the index to start searching from
+         * @return the index of the event, or size() if there is none
+         */
+        std::size_t find(midi::data_type type, std::size_t from=0) const {
+                for (std::size_t i = from; i < _nevents; ++i) {
+                        midi::event_t const & e = _events[i];
+                        if (e.size > 0 && (e.status & midi::type_nib) == type) return i;
+                }
+                return _nevents;
+        }
+
+        /**
+         * Find an onset or offset event.
+         *
+         * @param onset   if true, look for onset events; if false, for offsets
+         * @return the time of the first event, or -1 if no event was found.
+         */
+        int find_trigger(bool onset=true) const {
+                for (std::size_t i = 0; i < _nevents; ++i) {
+                        midi::event_t const & e = _events[i];
+                        if ((onset) ? midi::is_onset(e) : midi::is_offset(e))
+                                return e.time;
+                }
+                return -1;
+        }
+
+        /** The number of events that didn't fit in the cache, ever */
+        std::size_t dropped() const { return _dropped; }
+
+        /** The cycle the cache was last filled (maintained by the owner) */
+        unsigned long cycle() const { return _cycle; }
+        void set_cycle(unsigned long c) { _cycle = c; }
+
+private:
+        std::vector<midi::event_t> _events;
+        std::size_t _nevents;
+        std::size_t _dropped;
+        unsigned long _cycle;
+};
+
 }
 
 
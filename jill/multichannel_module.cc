@@ -0,0 +1,52 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <iostream>
+#include "multichannel_module.hh"
+
+using namespace jill;
+using std::string;
+using std::vector;
+
+multichannel_options::multichannel_options(string const & program_name)
+        : program_options(program_name)
+{
+        po::options_description jillopts("JILL options");
+        jillopts.add_options()
+                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
+                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
+                 "set client name")
+                ("channels,c", po::value<std::size_t>(&nchannels)->default_value(1),
+                 "number of input/output port pairs")
+                ("in,i",      po::value<vector<string> >(&input_ports),
+                 "add connection to input port (assigned to channels in order)")
+                ("out,o",     po::value<vector<string> >(&output_ports),
+                 "add connection to output port (assigned to channels in order)");
+        cmd_opts.add(jillopts);
+        visible_opts.add(jillopts);
+}
+
+void
+multichannel_options::print_ports(char const * in_desc, char const * out_desc) const
+{
+        std::cout << "Ports:\n"
+                  << " * in:        " << in_desc << "\n"
+                  << " * out:       " << out_desc << "\n"
+                  << " (with --channels > 1, in_NNN and out_NNN for each channel)\n"
+                  << std::endl;
+}
+
+void
+multichannel_options::print_usage()
+{
+        std::cout << "Usage: " << _program_name << " [options]\n"
+                  << visible_opts << std::endl;
+        print_ports("input port", "output port");
+}
@@ -0,0 +1,240 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _MULTICHANNEL_MODULE_HH
+#define _MULTICHANNEL_MODULE_HH
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <jack/jack.h>
+
+#include "types.hh"
+#include "jack_client.hh"
+#include "program_options.hh"
+
+/*
+ * Marks pointers that don't alias, so the compiler is free to vectorize simple
+ * loops over port buffers.
+ */
+#define JILL_RESTRICT __restrict__
+
+namespace jill {
+
+/**
+ * @ingroup clientgroup
+ * @brief options common to modules built on multichannel_module
+ *
+ * Handles server and client names, the number of channels, and the lists of
+ * ports to connect to. Deriving classes add a group of module-specific options
+ * in their constructor.
+ */
+class multichannel_options : public program_options {
+public:
+        multichannel_options(std::string const & program_name);
+
+	/** The server name */
+	std::string server_name;
+	/** The client name (used in internal JACK representations) */
+	std::string client_name;
+        /** The number of input/output port pairs */
+        std::size_t nchannels;
+
+	/** Ports to connect to */
+        std::vector<std::string> input_ports;
+	std::vector<std::string> output_ports;
+
+protected:
+        /** Print the list of ports for a module with the given port descriptions */
+        void print_ports(char const * in_desc, char const * out_desc) const;
+        virtual void print_usage();
+};
+
+/**
+ * @ingroup clientgroup
+ * @brief traits for the input side of a kernel
+ *
+ * Specialized for sample_t (audio inputs) and void (MIDI event inputs). MIDI
+ * kernels get the decoded events for the period (see jack_client::midi_events).
+ */
+template <typename T> struct input_traits;
+
+template <> struct input_traits<sample_t> {
+        typedef sample_t const * buffer_type;
+        static char const * port_type() { return JACK_DEFAULT_AUDIO_TYPE; }
+        static buffer_type buffer(jack_client * client, jack_port_t * port, nframes_t nframes) {
+                return client->samples(port, nframes);
+        }
+};
+
+template <> struct input_traits<void> {
+        typedef midi_event_cache const & buffer_type;
+        static char const * port_type() { return JACK_DEFAULT_MIDI_TYPE; }
+        static buffer_type buffer(jack_client * client, jack_port_t * port, nframes_t nframes) {
+                return *client->midi_events(port, nframes);
+        }
+};
+
+/**
+ * @ingroup clientgroup
+ * @brief base class for multichannel_module kernels
+ *
+ * A kernel processes one period of data for one channel. Deriving classes
+ * must define
+ *
+ *     void operator()(std::size_t chan, buffer_type in, sample_t * out, nframes_t nframes);
+ *
+ * and may hide the other members to respond to buffer size changes or to
+ * report latency. Any option values should be resolved when the kernel is
+ * constructed, so that the process loop doesn't have to look them up.
+ *
+ * @param T   sample_t for an audio input, void for a MIDI input
+ */
+template <typename T>
+struct module_kernel {
+        typedef T input_type;
+        typedef typename input_traits<T>::buffer_type buffer_type;
+
+        /** Called before activation and whenever the period size changes */
+        int buffer_size(std::size_t nchannels, nframes_t nframes) { return 0; }
+
+        /** The latency (in frames) the kernel adds between input and output */
+        nframes_t latency() const { return 0; }
+};
+
+/**
+ * @ingroup clientgroup
+ * @brief runs a kernel on N pairs of ports in a single client
+ *
+ * This class handles the boilerplate for simple modules that map each of N
+ * input ports to a corresponding audio output port. It registers the ports,
+ * installs the process, buffer size, and latency callbacks, and connects the
+ * ports. The process callback looks up the buffers and calls the kernel once
+ * per channel, so the per-sample loop is entirely in the kernel.
+ *
+ * JACK allocates port buffers on (at least) 16-byte boundaries, so kernels
+ * that loop over a whole period with JILL_RESTRICT pointers will be vectorized
+ * by the compiler.
+ *
+ * Single-channel modules keep the port names 'in' and 'out'. With more than
+ * one channel the ports are named 'in_NNN' and 'out_NNN'.
+ *
+ * @param Kernel   the kernel type, usually deriving from module_kernel
+ */
+template <typename Kernel>
+class multichannel_module : boost::noncopyable {
+
+public:
+        typedef typename Kernel::input_type input_type;
+        typedef input_traits<input_type> traits;
+
+        /**
+         * Register ports and callbacks. The client is not activated.
+         *
+         * @param client     the client to register ports with
+         * @param kernel     the kernel. Must outlive this object.
+         * @param nchannels  the number of input/output port pairs
+         */
+        multichannel_module(jack_client * client, Kernel & kernel, std::size_t nchannels)
+                : _client(client), _kernel(kernel), _nchannels(nchannels) {
+                if (_nchannels < 1)
+                        throw std::invalid_argument("number of channels must be at least 1");
+                _ports_in.reserve(nchannels);
+                _ports_out.reserve(nchannels);
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        _ports_in.push_back(client->register_port(port_name("in", c),
+                                                                  traits::port_type(),
+                                                                  JackPortIsInput, 0));
+                        _ports_out.push_back(client->register_port(port_name("out", c),
+                                                                   JACK_DEFAULT_AUDIO_TYPE,
+                                                                   JackPortIsOutput, 0));
+                }
+                _kernel.buffer_size(_nchannels, client->buffer_size());
+                client->set_buffer_size_callback(boost::bind(&multichannel_module::buffer_size,
+                                                             this, _1, _2));
+                client->set_process_callback(boost::bind(&multichannel_module::process,
+                                                          this, _1, _2, _3));
+                jack_set_latency_callback(client->client(), &multichannel_module::latency, this);
+        }
+
+        /**
+         * Connect the ports. If there's only one channel, all the connections
+         * are made to it; otherwise the connections are assigned to channels
+         * in order. Call after activating the client.
+         */
+        void connect_ports(std::vector<std::string> const & inputs,
+                           std::vector<std::string> const & outputs) {
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                        jack_port_t * port = _ports_in[i % _nchannels];
+                        _client->connect_port(inputs[i], jack_port_name(port));
+                }
+                for (std::size_t i = 0; i < outputs.size(); ++i) {
+                        jack_port_t * port = _ports_out[i % _nchannels];
+                        _client->connect_port(jack_port_name(port), outputs[i]);
+                }
+        }
+
+        std::size_t nchannels() const { return _nchannels; }
+
+private:
+        std::string port_name(char const * base, std::size_t chan) const {
+                if (_nchannels == 1) return base;
+                char buf[32];
+                sprintf(buf, "%s_%03zu", base, chan);
+                return buf;
+        }
+
+        int process(jack_client * client, nframes_t nframes, nframes_t) {
+                for (std::size_t c = 0; c < _nchannels; ++c) {
+                        _kernel(c,
+                                traits::buffer(client, _ports_in[c], nframes),
+                                client->samples(_ports_out[c], nframes),
+                                nframes);
+                }
+                return 0;
+        }
+
+        int buffer_size(jack_client *, nframes_t nframes) {
+                return _kernel.buffer_size(_nchannels, nframes);
+        }
+
+        static void latency(jack_latency_callback_mode_t mode, void * arg) {
+                multichannel_module * self = static_cast<multichannel_module*>(arg);
+                nframes_t delay = self->_kernel.latency();
+                jack_latency_range_t range;
+                for (std::size_t c = 0; c < self->_nchannels; ++c) {
+                        if (mode == JackCaptureLatency) {
+                                jack_port_get_latency_range(self->_ports_in[c], mode, &range);
+                                range.min += delay;
+                                range.max += delay;
+                                jack_port_set_latency_range(self->_ports_out[c], mode, &range);
+                        }
+                        else {
+                                jack_port_get_latency_range(self->_ports_out[c], mode, &range);
+                                range.min += delay;
+                                range.max += delay;
+                                jack_port_set_latency_range(self->_ports_in[c], mode, &range);
+                        }
+                }
+        }
+
+        jack_client * _client;
+        Kernel & _kernel;
+        std::size_t const _nchannels;
+        std::vector<jack_port_t *> _ports_in;
+        std::vector<jack_port_t *> _ports_out;
+};
+
+} // namespace jill
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _PIPELINED_KERNEL_HH
+#define _PIPELINED_KERNEL_HH
+
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <boost/noncopyable.hpp>
+#include <jack/thread.h>
+
+#include "types.hh"
+#include "jack_client.hh"
+#include "multichannel_module.hh"
+#include "util/thread_policy.hh"
+
+namespace jill {
+
+/**
+ * @ingroup clientgroup
+ * @brief runs a kernel on a worker thread, one period behind the process callback
+ *
+ * A kernel run by multichannel_module has to finish all its channels within
+ * the JACK cycle. This wrapper lets an expensive kernel use a full period on
+ * another core instead: each period, the process callback copies out the
+ * results the worker computed from the previous period, copies in the new
+ * input, and wakes the worker. The output is therefore delayed by exactly one
+ * period, which is added to the kernel's latency so that it's reported through
+ * the latency callback.
+ *
+ * If the worker hasn't finished when the next period starts, the output for
+ * that period is silent and its input is dropped (see overruns()). The output
+ * for the period after that is also silent, because the results the worker
+ * finished late belong to a period that has already been played. The process
+ * thread never waits on the worker.
+ *
+ * The worker is created with jack_client_create_thread, so it runs with
+ * realtime priority (just below the process thread) if the server does. Only
+ * an explicit policy for the worker role changes this (see thread_policy).
+ *
+ * @param Kernel  a kernel with sampled input (see module_kernel)
+ */
+template <typename Kernel>
+class pipelined_kernel : public module_kernel<sample_t>, boost::noncopyable {
+public:
+        /**
+         * Start the worker thread.
+         *
+         * @param client  the client, used to create the thread
+         * @param kernel  the kernel to run. Must outlive this object.
+         */
+        pipelined_kernel(jack_client * client, Kernel & kernel)
+                : _kernel(kernel), _nchannels(0), _nframes(0), _busy(0), _handoff(false),
+                  _stale(false), _stopping(0), _overruns(0) {
+                sem_init(&_work, 0, 0);
+                jack_client_t * c = client->client();
+                int priority = jack_client_real_time_priority(c);
+                if (jack_client_create_thread(c, &_thread, (priority > 1) ? priority - 1 : 0,
+                                              jack_is_realtime(c), thread, this) != 0)
+                        throw JackError("unable to start worker thread");
+        }
+
+        ~pipelined_kernel() {
+                __sync_add_and_fetch(&_stopping, 1);
+                sem_post(&_work);
+                pthread_join(_thread, 0);
+                sem_destroy(&_work);
+        }
+
+        /** Called by multichannel_module for each channel, in order */
+        void operator()(std::size_t chan, sample_t const * in, sample_t * out, nframes_t nframes) {
+                // the buffers can only be touched if the worker is idle
+                if (chan == 0) {
+                        _handoff = (__sync_add_and_fetch(&_busy, 0) == 0);
+                        if (!_handoff) {
+                                __sync_add_and_fetch(&_overruns, 1);
+                                _stale = true;
+                        }
+                }
+                if (!_handoff) {
+                        memset(out, 0, nframes * sizeof(sample_t));
+                        return;
+                }
+                std::size_t offset = chan * _nframes;
+                // after an overrun, _out holds the results for an earlier period
+                if (_stale)
+                        memset(out, 0, nframes * sizeof(sample_t));
+                else
+                        memcpy(out, &_out[offset], nframes * sizeof(sample_t));
+                memcpy(&_in[offset], in, nframes * sizeof(sample_t));
+                if (chan + 1 == _nchannels) {
+                        _stale = false;
+                        __sync_lock_test_and_set(&_busy, 1);
+                        sem_post(&_work);
+                }
+        }
+
+        /** Waits for the worker to finish, then reallocates the buffers */
+        int buffer_size(std::size_t nchannels, nframes_t nframes) {
+                while (__sync_add_and_fetch(&_busy, 0) != 0)
+                        usleep(100);
+                _nchannels = nchannels;
+                _nframes = nframes;
+                _in.assign(nchannels * nframes, 0.0f);
+                _out.assign(nchannels * nframes, 0.0f);
+                return _kernel.buffer_size(nchannels, nframes);
+        }
+
+        /** The kernel's latency plus one period */
+        nframes_t latency() const { return _nframes + _kernel.latency(); }
+
+        /** The number of periods dropped because the worker wasn't finished */
+        unsigned long overruns() const { return _overruns; }
+
+private:
+        static void * thread(void * arg) {
+                pipelined_kernel * self = static_cast<pipelined_kernel*>(arg);
+                util::thread_policy::apply("worker", false);
+                while (1) {
+                        sem_wait(&self->_work);
+                        if (__sync_add_and_fetch(&self->_stopping, 0)) break;
+                        nframes_t const nframes = self->_nframes;
+                        for (std::size_t c = 0; c < self->_nchannels; ++c) {
+                                self->_kernel(c, &self->_in[c * nframes], &self->_out[c * nframes],
+                                              nframes);
+                        }
+                        __sync_lock_release(&self->_busy);
+                }
+                return 0;
+        }
+
+        Kernel & _kernel;
+        std::size_t _nchannels;
+        nframes_t _nframes;
+        std::vector<sample_t> _in;      // input for the worker
+        std::vector<sample_t> _out;     // output from the worker
+        jack_native_thread_t _thread;
+        sem_t _work;                    // posted when the buffers are handed to the worker
+        int _busy;                      // nonzero while the worker owns the buffers
+        bool _handoff;                  // whether the buffers are handed off this period
+        bool _stale;                    // whether _out is from before an overrun
+        int _stopping;
+        unsigned long _overruns;
+};
+
+} // namespace jill
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <stdexcept>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <jack/midiport.h>
+
+#include "processing_graph.hh"
+#include "logging.hh"
+
+using namespace jill;
+using std::string;
+using std::vector;
+
+processing_graph::processing_graph(jack_client * client)
+        : _client(client)
+{}
+
+void
+processing_graph::add_input(string const & name)
+{
+        if (_output_idx.count(name))
+                throw std::invalid_argument("duplicate name in processing graph: " + name);
+        output_entry out = { name, 0, graph_node::AUDIO, 0 };
+        out.port = _client->register_port(name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+        _output_idx[name] = _outputs.size();
+        _outputs.push_back(out);
+}
+
+void
+processing_graph::add_node(string const & name, graph_node * node, vector<string> const & sources)
+{
+        _nodes.push_back(node); // takes ownership even if we throw
+        node_entry entry;
+        entry.name = name;
+        entry.sources = sources;
+        entry.port = 0;
+        _entries.push_back(entry);
+        for (vector<node_entry>::const_iterator it = _entries.begin(); it + 1 != _entries.end(); ++it) {
+                if (it->name == name)
+                        throw std::invalid_argument("duplicate name in processing graph: " + name);
+        }
+        if (_output_idx.count(name))
+                throw std::invalid_argument("duplicate name in processing graph: " + name);
+}
+
+void
+processing_graph::start()
+{
+        std::size_t const nnodes = _nodes.size();
+        std::map<string, std::size_t> node_idx;
+        for (std::size_t i = 0; i < nnodes; ++i)
+                node_idx[_entries[i].name] = i;
+
+        // count unprocessed sources, and check that they all exist
+        vector<std::size_t> pending(nnodes, 0);
+        vector<vector<std::size_t> > consumers(nnodes);
+        for (std::size_t i = 0; i < nnodes; ++i) {
+                vector<string> const & sources = _entries[i].sources;
+                if (sources.empty())
+                        throw std::invalid_argument("node " + _entries[i].name + " has no sources");
+                for (vector<string>::const_iterator s = sources.begin(); s != sources.end(); ++s) {
+                        std::map<string, std::size_t>::const_iterator n = node_idx.find(*s);
+                        if (n != node_idx.end()) {
+                                pending[i] += 1;
+                                consumers[n->second].push_back(i);
+                        }
+                        else if (_output_idx.count(*s) == 0) {
+                                throw std::invalid_argument("node " + _entries[i].name +
+                                                            ": no such source " + *s);
+                        }
+                }
+        }
+
+        // topological sort, keeping the order nodes were added where possible
+        _order.clear();
+        vector<bool> done(nnodes, false);
+        while (_order.size() < nnodes) {
+                std::size_t i = 0;
+                while (i < nnodes && (done[i] || pending[i] > 0)) ++i;
+                if (i == nnodes)
+                        throw std::invalid_argument("processing graph contains a cycle");
+                done[i] = true;
+                _order.push_back(i);
+                for (vector<std::size_t>::const_iterator c = consumers[i].begin();
+                     c != consumers[i].end(); ++c)
+                        pending[*c] -= 1;
+        }
+
+        // register outputs in processing order and resolve sources
+        _node_output.clear();
+        for (vector<std::size_t>::const_iterator it = _order.begin(); it != _order.end(); ++it) {
+                node_entry & entry = _entries[*it];
+                graph_node & node = _nodes[*it];
+                output_entry out = { entry.name, 0, node.output(), &node };
+                if (out.type == graph_node::AUDIO)
+                        out.port = _client->register_port(entry.name, JACK_DEFAULT_AUDIO_TYPE,
+                                                          JackPortIsOutput, 0);
+                else if (out.type == graph_node::EVENTS)
+                        out.port = _client->register_port(entry.name, JACK_DEFAULT_MIDI_TYPE,
+                                                          JackPortIsOutput, 0);
+                entry.port = out.port;
+
+                entry.source_idx.clear();
+                entry.io.inputs.clear();
+                for (vector<string>::const_iterator s = entry.sources.begin();
+                     s != entry.sources.end(); ++s) {
+                        std::size_t idx = _output_idx[*s];
+                        if (_outputs[idx].type == graph_node::NONE)
+                                throw std::invalid_argument("node " + entry.name + ": source " +
+                                                            *s + " has no output");
+                        if (_outputs[idx].type == graph_node::EVENTS && !node.accepts_events())
+                                throw std::invalid_argument("node " + entry.name + ": source " +
+                                                            *s + " is not sampled data");
+                        node_io::source source = { *s, 0, 0 };
+                        entry.source_idx.push_back(idx);
+                        entry.io.inputs.push_back(source);
+                }
+                _node_output.push_back(_outputs.size());
+                _output_idx[entry.name] = _outputs.size();
+                _outputs.push_back(out);
+        }
+        log_msg msg;
+        msg << "processing order:";
+        for (vector<std::size_t>::const_iterator it = _order.begin(); it != _order.end(); ++it)
+                msg << " " << _entries[*it].name;
+
+        buffer_size(_client, _client->buffer_size());
+        _client->set_buffer_size_callback(boost::bind(&processing_graph::buffer_size, this, _1, _2));
+        _client->set_xrun_callback(boost::bind(&processing_graph::xrun, this, _1, _2));
+        _client->set_process_callback(boost::bind(&processing_graph::process, this, _1, _2, _3));
+        jack_set_latency_callback(_client->client(), &processing_graph::latency, this);
+}
+
+vector<string>
+processing_graph::order() const
+{
+        vector<string> out;
+        for (vector<std::size_t>::const_iterator it = _order.begin(); it != _order.end(); ++it)
+                out.push_back(_entries[*it].name);
+        return out;
+}
+
+int
+processing_graph::process(jack_client * client, nframes_t nframes, nframes_t time)
+{
+        std::size_t const nnodes = _order.size();
+        for (std::size_t k = 0; k < nnodes; ++k) {
+                std::size_t const i = _order[k];
+                node_entry & entry = _entries[i];
+                output_entry const & self = _outputs[_node_output[k]];
+                std::size_t const nsources = entry.source_idx.size();
+                for (std::size_t s = 0; s < nsources; ++s) {
+                        output_entry const & src = _outputs[entry.source_idx[s]];
+                        node_io::source & input = entry.io.inputs[s];
+                        // sources come earlier in the order, so their buffers are filled
+                        if (src.type == graph_node::AUDIO)
+                                input.samples = client->samples(src.port, nframes);
+                        else
+                                input.events = jack_port_get_buffer(src.port, nframes);
+                }
+                entry.io.samples = (self.type == graph_node::AUDIO) ?
+                        client->samples(self.port, nframes) : 0;
+                entry.io.events = (self.type == graph_node::EVENTS) ?
+                        client->events(self.port, nframes) : 0;
+                _nodes[i].process(entry.io, nframes, time);
+        }
+        return 0;
+}
+
+int
+processing_graph::buffer_size(jack_client *, nframes_t nframes)
+{
+        int ret = 0;
+        for (boost::ptr_vector<graph_node>::iterator it = _nodes.begin(); it != _nodes.end(); ++it) {
+                int r = it->buffer_size(nframes);
+                if (r) ret = r;
+        }
+        return ret;
+}
+
+int
+processing_graph::xrun(jack_client *, float)
+{
+        for (boost::ptr_vector<graph_node>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
+                it->xrun();
+        return 0;
+}
+
+/*
+ * Capture latencies are propagated forward through the graph, starting with the
+ * input ports, and playback latencies are propagated backward from the node
+ * outputs. A node's output gets the range of its sources plus its own latency.
+ */
+void
+processing_graph::latency(jack_latency_callback_mode_t mode, void * arg)
+{
+        processing_graph * self = static_cast<processing_graph*>(arg);
+        vector<output_entry> const & outputs = self->_outputs;
+        std::size_t const ninputs = outputs.size() - self->_order.size();
+        vector<jack_latency_range_t> ranges(outputs.size());
+        vector<bool> known(outputs.size(), false);
+
+        if (mode == JackCaptureLatency) {
+                for (std::size_t i = 0; i < ninputs; ++i) {
+                        jack_port_get_latency_range(outputs[i].port, mode, &ranges[i]);
+                        known[i] = true;
+                }
+                for (std::size_t k = 0; k < self->_order.size(); ++k) {
+                        node_entry const & entry = self->_entries[self->_order[k]];
+                        std::size_t const o = self->_node_output[k];
+                        nframes_t delay = outputs[o].node->latency();
+                        for (std::size_t s = 0; s < entry.source_idx.size(); ++s) {
+                                jack_latency_range_t const & r = ranges[entry.source_idx[s]];
+                                if (!known[o]) {
+                                        ranges[o] = r;
+                                        known[o] = true;
+                                }
+                                ranges[o].min = std::min(ranges[o].min, r.min);
+                                ranges[o].max = std::max(ranges[o].max, r.max);
+                        }
+                        ranges[o].min += delay;
+                        ranges[o].max += delay;
+                        if (outputs[o].port)
+                                jack_port_set_latency_range(outputs[o].port, mode, &ranges[o]);
+                }
+        }
+        else {
+                for (std::size_t k = self->_order.size(); k > 0; --k) {
+                        node_entry const & entry = self->_entries[self->_order[k - 1]];
+                        std::size_t const o = self->_node_output[k - 1];
+                        jack_latency_range_t r;
+                        if (outputs[o].port) {
+                                // downstream clients; merged with downstream nodes
+                                jack_port_get_latency_range(outputs[o].port, mode, &r);
+                                if (known[o]) {
+                                        r.min = std::min(r.min, ranges[o].min);
+                                        r.max = std::max(r.max, ranges[o].max);
+                                }
+                                jack_port_set_latency_range(outputs[o].port, mode, &r);
+                        }
+                        else if (known[o]) {
+                                r = ranges[o];
+                        }
+                        else {
+                                r.min = r.max = 0;
+                        }
+                        nframes_t delay = outputs[o].node->latency();
+                        r.min += delay;
+                        r.max += delay;
+                        for (std::size_t s = 0; s < entry.source_idx.size(); ++s) {
+                                std::size_t const src = entry.source_idx[s];
+                                if (!known[src]) {
+                                        ranges[src] = r;
+                                        known[src] = true;
+                                }
+                                ranges[src].min = std::min(ranges[src].min, r.min);
+                                ranges[src].max = std::max(ranges[src].max, r.max);
+                        }
+                }
+                for (std::size_t i = 0; i < ninputs; ++i) {
+                        if (known[i])
+                                jack_port_set_latency_range(outputs[i].port, mode, &ranges[i]);
+                }
+        }
+}
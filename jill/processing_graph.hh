@@ -0,0 +1,156 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _PROCESSING_GRAPH_HH
+#define _PROCESSING_GRAPH_HH
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <jack/jack.h>
+
+#include "types.hh"
+#include "jack_client.hh"
+
+namespace jill {
+
+/**
+ * @ingroup clientgroup
+ * @brief the data a graph node sees in one period
+ */
+struct node_io {
+        /** One of the node's sources */
+        struct source {
+                std::string name;               // the name of the node or input
+                sample_t const * samples;       // audio data, or 0 if the source emits events
+                void * events;                  // JACK midi buffer, or 0 if the source is audio
+        };
+        std::vector<source> inputs;
+        /** The node's audio output, or 0 if it doesn't have one */
+        sample_t * samples;
+        /** The node's event output (a cleared JACK midi buffer), or 0 */
+        void * events;
+};
+
+/**
+ * @ingroup clientgroup
+ * @brief a processing step in a processing_graph
+ *
+ * Each node reads the outputs of one or more sources and writes to its own
+ * output, which can be audio, events, or nothing (e.g. for a node that records
+ * its inputs). Like module_kernel, options should be resolved when the node is
+ * constructed, so that process() doesn't have to look them up.
+ */
+class graph_node : boost::noncopyable {
+public:
+        enum output_type { AUDIO, EVENTS, NONE };
+
+        virtual ~graph_node() {}
+
+        /** The type of the node's output */
+        virtual output_type output() const { return AUDIO; }
+
+        /** Whether the node can read sources that emit events */
+        virtual bool accepts_events() const { return false; }
+
+        /** Process one period of data */
+        virtual void process(node_io & io, nframes_t nframes, nframes_t time) = 0;
+
+        /** Called before activation and whenever the period size changes */
+        virtual int buffer_size(nframes_t nframes) { return 0; }
+
+        /** The latency (in frames) the node adds between its inputs and output */
+        virtual nframes_t latency() const { return 0; }
+
+        /** Called when the server reports an xrun. Not called in the process thread. */
+        virtual void xrun() {}
+};
+
+/**
+ * @ingroup clientgroup
+ * @brief runs a graph of processing steps in a single client
+ *
+ * Chaining separate modules (e.g. jfilter -> jdetect -> jrecord) routes every
+ * period through the server between steps. This class instead runs a set of
+ * nodes in one process callback, in an order where each node comes after its
+ * sources. Each node's output is a port owned by the client (named after the
+ * node), so it can also be connected to other clients, and downstream nodes
+ * read the port buffer directly.
+ *
+ * Build the graph with add_input() and add_node(), then call start() before
+ * activating the client.
+ */
+class processing_graph : boost::noncopyable {
+public:
+        explicit processing_graph(jack_client * client);
+
+        /** Register an audio input port that nodes can use as a source */
+        void add_input(std::string const & name);
+
+        /**
+         * Add a node to the graph.
+         *
+         * @param name     the name of the node and its output port
+         * @param node     the node. The graph takes ownership.
+         * @param sources  the names of inputs or other nodes to read from
+         */
+        void add_node(std::string const & name, graph_node * node,
+                      std::vector<std::string> const & sources);
+
+        /**
+         * Determine the processing order, register output ports, and install
+         * the process, buffer size, xrun, and latency callbacks.
+         *
+         * @throws std::invalid_argument if a source doesn't exist, or the
+         *         graph has a cycle
+         */
+        void start();
+
+        /** The names of the nodes in processing order (after start()) */
+        std::vector<std::string> order() const;
+
+        std::size_t nnodes() const { return _nodes.size(); }
+
+private:
+        struct node_entry {
+                std::string name;
+                std::vector<std::string> sources;
+                std::vector<std::size_t> source_idx;   // indices into _outputs
+                jack_port_t * port;
+                node_io io;
+        };
+
+        /* an input port or node output */
+        struct output_entry {
+                std::string name;
+                jack_port_t * port;
+                graph_node::output_type type;
+                graph_node * node;      // 0 for inputs
+        };
+
+        int process(jack_client * client, nframes_t nframes, nframes_t time);
+        int buffer_size(jack_client * client, nframes_t nframes);
+        int xrun(jack_client * client, float delay);
+        static void latency(jack_latency_callback_mode_t mode, void * arg);
+
+        jack_client * _client;
+        boost::ptr_vector<graph_node> _nodes;
+        std::vector<node_entry> _entries;       // parallel to _nodes
+        std::vector<output_entry> _outputs;     // inputs first, then nodes in _order
+        std::vector<std::size_t> _node_output;  // index into _outputs for each node in _order
+        std::vector<std::size_t> _order;        // indices into _nodes
+        std::map<std::string, std::size_t> _output_idx;
+};
+
+} // namespace jill
+
+#endif
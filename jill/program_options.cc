@@ -16,6 +16,8 @@
 #include "logging.hh"
 #include "logger.hh"
 #include "program_options.hh"
+#include "jack_client.hh"
+#include "util/thread_policy.hh"
 
 using namespace jill;
 using std::string;
@@ -29,7 +31,12 @@ program_options::program_options(std::string const &program_name)
 	generic.add_options()
 		("version,v", "print version string")
 		("help,h",    "print help message")
-		("config,C",  po::value<string>(), "load options from a ini file (overruled by command-line)");
+		("config,C",  po::value<string>(), "load options from a ini file (overruled by command-line)")
+                ("thread-policy", po::value<vector<string> >(),
+                 "set cpus and priority of helper threads (role:cpus=LIST,priority=N)")
+                ("mlock", "lock process memory to prevent paging")
+                ("profile", po::value<float>()->implicit_value(0),
+                 "log process callback load every N seconds (or on SIGUSR1 if N=0)");
 	cmd_opts.add(generic);
 	visible_opts.add(generic);
 }
@@ -84,6 +91,20 @@ program_options::parse(int argc, char **argv)
         }
 
 	po::notify(vmap);
+        if (vmap.count("thread-policy")) {
+                vector<string> const & specs = vmap["thread-policy"].as<vector<string> >();
+                for (vector<string>::const_iterator it = specs.begin(); it != specs.end(); ++it) {
+                        try {
+                                util::thread_policy::configure(*it);
+                        }
+                        catch (std::invalid_argument const & e) {
+                                LOG << "ERROR: " << e.what();
+                                throw Exit(EXIT_FAILURE);
+                        }
+                }
+        }
+        if (vmap.count("mlock")) util::thread_policy::lock_memory();
+        if (vmap.count("profile")) jack_client::set_default_profiling(get<float>("profile"));
 	process_options();
 }
 
@@ -36,15 +36,28 @@ public:
         /** The sampling rate of the stimulus */
         virtual nframes_t samplerate() const = 0;
 
+        /** The number of channels in the stimulus */
+        virtual std::size_t nchannels() const { return 1; }
+
         /** The duration of the stimulus */
         virtual float duration() const { return float(nframes()) / samplerate(); }
 
         /**
          * The buffer for the stimulus. May be 0 if not loaded. If not 0, the
-         * length of the array will be equal to nframes()
+         * length of the array will be equal to nframes(). For multichannel
+         * stimuli, this is the first channel.
          */
         virtual sample_t const * buffer() const = 0;
 
+        /**
+         * The buffer for one channel of the stimulus. Each channel is stored
+         * in its own contiguous array of length nframes(). Returns 0 if the
+         * samples are not loaded or if @a chan >= nchannels().
+         */
+        virtual sample_t const * buffer(std::size_t chan) const {
+                return (chan == 0) ? buffer() : 0;
+        }
+
         /**
          * Load samples and resample as needed.  Only needs to be called if
          * buffer() == 0, but may be called multiple times.
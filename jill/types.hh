@@ -14,6 +14,7 @@
 #include <jack/types.h>
 #include <jack/transport.h>
 #include <iosfwd>
+#include <cstring>
 #include <stdexcept>
 
 /**
@@ -73,6 +74,13 @@ struct data_block_t {
                                    sz_id);
         }
 
+        /** true if the id of the block is @a name. Doesn't allocate */
+        bool id_matches(std::string const & name) const {
+                return sz_id == name.length() &&
+                        memcmp(reinterpret_cast<char const *>(this) + sizeof(data_block_t),
+                               name.data(), sz_id) == 0;
+        }
+
         /** pointer to the block's data */
         void const * data() const {
                 return reinterpret_cast<char const *>(this) + sizeof(data_block_t) + sz_id;
@@ -10,6 +10,7 @@
  */
 #include "../logging.hh"
 #include "readahead_stimqueue.hh"
+#include "thread_policy.hh"
 
 using namespace jill::util;
 
@@ -51,6 +52,7 @@ readahead_stimqueue::thread(void * arg)
 {
 	pthread_setcanceltype (PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
         readahead_stimqueue * self = static_cast<readahead_stimqueue *>(arg);
+        thread_policy::apply("loader");
         self->loop();
         return 0;
 }
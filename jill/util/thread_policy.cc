@@ -0,0 +1,218 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <map>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <boost/algorithm/string.hpp>
+
+#include "../logging.hh"
+#include "thread_policy.hh"
+
+using namespace jill::util;
+using std::string;
+using std::vector;
+
+namespace {
+
+/* policies are set at startup, but threads may look them up at any time */
+pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+std::map<string, thread_policy::policy> &
+policies()
+{
+        static std::map<string, thread_policy::policy> p;
+        return p;
+}
+
+/* parse a kernel-style cpu list (e.g. 0-1,3) */
+vector<int>
+parse_list(string const & list)
+{
+        vector<int> out;
+        vector<string> items;
+        boost::split(items, list, boost::is_any_of(","), boost::token_compress_on);
+        for (vector<string>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                string item = boost::trim_copy(*it);
+                if (item.empty()) continue;
+                char * end;
+                long first = strtol(item.c_str(), &end, 10);
+                long last = first;
+                if (*end == '-') last = strtol(end + 1, &end, 10);
+                if (*end != '\0' || first < 0 || last < first)
+                        throw std::invalid_argument("invalid cpu list: " + list);
+                for (long c = first; c <= last; ++c) out.push_back(c);
+        }
+        return out;
+}
+
+vector<int>
+read_list(char const * path)
+{
+        std::ifstream f(path);
+        string line;
+        if (!f || !std::getline(f, line)) return vector<int>();
+        return parse_list(line);
+}
+
+} // anonymous namespace
+
+vector<int>
+thread_policy::isolated_cpus()
+{
+        return read_list("/sys/devices/system/cpu/isolated");
+}
+
+vector<int>
+thread_policy::online_cpus()
+{
+        vector<int> out = read_list("/sys/devices/system/cpu/online");
+        if (out.empty()) {
+                long n = sysconf(_SC_NPROCESSORS_ONLN);
+                for (long c = 0; c < n; ++c) out.push_back(c);
+        }
+        return out;
+}
+
+vector<int>
+thread_policy::parse_cpus(string const & list)
+{
+        if (list == "isolated") {
+                return isolated_cpus();
+        }
+        else if (list == "shared") {
+                vector<int> online = online_cpus();
+                vector<int> isolated = isolated_cpus();
+                vector<int> out;
+                for (vector<int>::const_iterator c = online.begin(); c != online.end(); ++c) {
+                        if (std::find(isolated.begin(), isolated.end(), *c) == isolated.end())
+                                out.push_back(*c);
+                }
+                return out;
+        }
+        return parse_list(list);
+}
+
+void
+thread_policy::configure(string const & spec)
+{
+        string::size_type colon = spec.find(':');
+        if (colon == string::npos || colon == 0)
+                throw std::invalid_argument("thread policy syntax: role:key=value,...");
+        policy p = { vector<int>(), -1 };
+        // cpu lists contain commas, so items without '=' continue the last value
+        vector<string> items;
+        string rest = spec.substr(colon + 1);
+        boost::split(items, rest, boost::is_any_of(","), boost::token_compress_on);
+        vector<std::pair<string, string> > keyvals;
+        for (vector<string>::const_iterator it = items.begin(); it != items.end(); ++it) {
+                string::size_type eq = it->find('=');
+                if (eq != string::npos)
+                        keyvals.push_back(std::make_pair(it->substr(0, eq), it->substr(eq + 1)));
+                else if (!keyvals.empty())
+                        keyvals.back().second += "," + *it;
+                else
+                        throw std::invalid_argument("thread policy syntax: role:key=value,...");
+        }
+        for (vector<std::pair<string, string> >::const_iterator it = keyvals.begin();
+             it != keyvals.end(); ++it) {
+                if (it->first == "cpus")
+                        p.cpus = parse_cpus(it->second);
+                else if (it->first == "priority")
+                        p.priority = atoi(it->second.c_str());
+                else
+                        throw std::invalid_argument("unknown thread policy key: " + it->first);
+        }
+        configure(spec.substr(0, colon), p);
+}
+
+void
+thread_policy::configure(string const & role, policy const & p)
+{
+        pthread_mutex_lock(&policy_lock);
+        policies()[role] = p;
+        pthread_mutex_unlock(&policy_lock);
+}
+
+thread_policy::policy
+thread_policy::get(string const & role, bool fallback)
+{
+        policy p = { vector<int>(), -1 };
+        pthread_mutex_lock(&policy_lock);
+        std::map<string, policy>::const_iterator it = policies().find(role);
+        if (it == policies().end() && fallback) it = policies().find("default");
+        if (it != policies().end()) p = it->second;
+        pthread_mutex_unlock(&policy_lock);
+        return p;
+}
+
+int
+thread_policy::apply(char const * role, bool fallback)
+{
+        policy p = get(role, fallback);
+        int ret = 0;
+#ifdef __linux__
+        if (!p.cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (vector<int>::const_iterator c = p.cpus.begin(); c != p.cpus.end(); ++c)
+                        CPU_SET(*c, &set);
+                int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if (err) {
+                        LOG << "WARNING: unable to set cpu affinity for " << role << " thread: "
+                            << strerror(err);
+                        ret = err;
+                }
+        }
+#endif
+        if (p.priority >= 0) {
+                struct sched_param param;
+                memset(&param, 0, sizeof(param));
+                param.sched_priority = p.priority;
+                int err = pthread_setschedparam(pthread_self(),
+                                                (p.priority > 0) ? SCHED_FIFO : SCHED_OTHER,
+                                                &param);
+                if (err) {
+                        LOG << "WARNING: unable to set priority for " << role << " thread: "
+                            << strerror(err);
+                        ret = err;
+                }
+        }
+        if (ret == 0 && (p.priority >= 0 || !p.cpus.empty())) {
+                log_msg msg;
+                msg << role << " thread:";
+                if (p.priority >= 0) msg << " priority=" << p.priority;
+                if (!p.cpus.empty()) {
+                        msg << " cpus=";
+                        for (std::size_t i = 0; i < p.cpus.size(); ++i)
+                                msg << ((i > 0) ? "," : "") << p.cpus[i];
+                }
+        }
+        return ret;
+}
+
+int
+thread_policy::lock_memory()
+{
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+                LOG << "WARNING: unable to lock memory: " << strerror(errno);
+                return errno;
+        }
+        LOG << "locked process memory";
+        return 0;
+}
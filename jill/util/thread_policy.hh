@@ -0,0 +1,92 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _THREAD_POLICY_HH
+#define _THREAD_POLICY_HH
+
+#include <string>
+#include <vector>
+
+namespace jill { namespace util {
+
+/**
+ * @ingroup miscgroup
+ * @brief scheduling and CPU placement for helper threads
+ *
+ * The library's helper threads (the disk writer, stimulus loader, encoders,
+ * etc.) call apply() with the name of their role when they start. By default
+ * nothing changes, so they run with normal scheduling on any CPU. Policies set
+ * with configure() can pin a role to a set of CPUs, for example to keep the
+ * disk writer off the core that runs the JACK process thread, and can give it
+ * realtime (SCHED_FIFO) priority.
+ *
+ * Roles used by the library: writer (buffered_data_writer, and closing ARF
+ * files), loader (readahead_stimqueue), encoder (chunk_encoder), and worker
+ * (pipelined_kernel). The role "default" applies to any role without its own
+ * policy, except for threads created by JACK (the worker), which already have
+ * realtime scheduling and are only changed by a policy for their own role.
+ * Policies should be configured before the threads are started; the
+ * logger thread starts before options are parsed and is not affected.
+ *
+ * CPU lists are comma-separated numbers and ranges (e.g. 0,2-3), or one of the
+ * keywords 'isolated' (the CPUs the kernel was told to isolate with isolcpus)
+ * or 'shared' (online CPUs that are not isolated).
+ */
+class thread_policy {
+public:
+        struct policy {
+                std::vector<int> cpus;  // CPUs to run on (empty for any)
+                int priority;           // SCHED_FIFO priority, 0 for normal, -1 for unchanged
+        };
+
+        /**
+         * Set the policy for a role.
+         *
+         * @param spec  role:key=value[,key=value...], with keys cpus and
+         *              priority. For example, writer:cpus=2-3,priority=10
+         * @throws std::invalid_argument for malformed specifications
+         */
+        static void configure(std::string const & spec);
+
+        /** Set the policy for a role */
+        static void configure(std::string const & role, policy const & p);
+
+        /**
+         * Get the policy for a role. If the role has no policy and fallback
+         * is true, returns the default policy.
+         */
+        static policy get(std::string const & role, bool fallback=true);
+
+        /**
+         * Apply the policy for a role to the calling thread. Failures (e.g.
+         * insufficient privileges for realtime scheduling) are logged.
+         *
+         * @param role      the role of the thread
+         * @param fallback  if false, the default policy isn't used
+         * @return 0 on success, or an error code
+         */
+        static int apply(char const * role, bool fallback=true);
+
+        /** Lock the process's current and future memory to prevent paging */
+        static int lock_memory();
+
+        /** The CPUs isolated from the scheduler (from /sys/devices/system/cpu/isolated) */
+        static std::vector<int> isolated_cpus();
+
+        /** The online CPUs */
+        static std::vector<int> online_cpus();
+
+        /** Parse a list of CPUs, e.g. 0,2-3 or one of the keywords */
+        static std::vector<int> parse_cpus(std::string const & list);
+};
+
+}} // namespace jill::util
+
+#endif
@@ -61,4 +61,58 @@ send(void *socket, std::string const & string, int flags)
         return rc;
 }
 
+static const char log_batch_sig[] = { '\xCD', '\xC0', '\x0A' };
+
+void
+log_batch_init(std::string & buf, std::string const & source)
+{
+        buf.assign(log_batch_sig, sizeof(log_batch_sig));
+        buf.append(source.c_str(), source.length() + 1);
+}
+
+void
+log_batch_append(std::string & buf, boost::int64_t usec, char const * msg, std::size_t size)
+{
+        char hdr[10];
+        if (size > 0xffff) size = 0xffff;
+        // network order
+        for (int i = 0; i < 8; ++i)
+                hdr[i] = (char)((boost::uint64_t)usec >> (56 - 8 * i));
+        hdr[8] = (char)(size >> 8);
+        hdr[9] = (char)(size);
+        buf.append(hdr, sizeof(hdr));
+        buf.append(msg, size);
+}
+
+int
+log_batch_parse(msg_ptr_t const & message, log_batch_visitor const & fn)
+{
+        zmq_msg_t * msg = const_cast<zmq_msg_t *>(message.get());
+        unsigned char const * ptr = (unsigned char const *) zmq_msg_data(msg);
+        unsigned char const * end = ptr + zmq_msg_size(msg);
+
+        if (end - ptr < (long)sizeof(log_batch_sig) ||
+            memcmp(ptr, log_batch_sig, sizeof(log_batch_sig)) != 0)
+                return -1;
+        ptr += sizeof(log_batch_sig);
+        unsigned char const * term = (unsigned char const *) memchr(ptr, 0, end - ptr);
+        if (term == 0) return -1;
+        std::string source((char const *) ptr, term - ptr);
+        ptr = term + 1;
+
+        int n = 0;
+        while (end - ptr >= 10) {
+                boost::uint64_t usec = 0;
+                for (int i = 0; i < 8; ++i)
+                        usec = (usec << 8) | ptr[i];
+                std::size_t size = (ptr[8] << 8) | ptr[9];
+                ptr += 10;
+                if ((std::size_t)(end - ptr) < size) break;   // truncated
+                fn(source, (boost::int64_t) usec, (char const *) ptr, size);
+                ptr += size;
+                ++n;
+        }
+        return n;
+}
+
 }
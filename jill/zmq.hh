@@ -14,6 +14,8 @@
 
 #include <zmq.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
 #include <string>
 
 // shims for zmq 2.2 vs 3.x
@@ -61,5 +63,27 @@ int send(void *socket, T const & data, int flags=0)
         return rc;
 }
 
+/*
+ * Batched log messages (IEATEDALOT in doc/jillctl.abnf). A batch carries any
+ * number of timestamped messages from one source in a single zmq message, with
+ * binary timestamps so neither end has to format or parse time strings.
+ */
+
+/** Start a new batch of log messages from @a source in @a buf */
+void log_batch_init(std::string & buf, std::string const & source);
+
+/** Append a message to a batch. Messages longer than 65535 bytes are truncated */
+void log_batch_append(std::string & buf, boost::int64_t usec, char const * msg, std::size_t size);
+
+/** Callback for log_batch_parse: source, microseconds since epoch, message, message length */
+typedef boost::function<void (std::string const &, boost::int64_t, char const *, std::size_t)> log_batch_visitor;
+
+/**
+ * Parse a batch of log messages, calling @a fn for each one.
+ *
+ * @return the number of messages, or -1 if @a message is not a batch
+ */
+int log_batch_parse(msg_ptr_t const & message, log_batch_visitor const & fn);
+
 }
 #endif /* _ZMQ_HELPERS_H_ */
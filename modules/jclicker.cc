@@ -9,75 +9,64 @@
 #include "jill/logging.hh"
 #include "jill/jack_client.hh"
 #include "jill/midi.hh"
-#include "jill/program_options.hh"
+#include "jill/multichannel_module.hh"
 
 #define PROGRAM_NAME "jclicker"
 
 using namespace jill;
 using std::string;
-typedef std::vector<string> stringvec;
 
-class jclicker_options : public program_options {
+class jclicker_options : public multichannel_options {
 
 public:
 	jclicker_options(string const &program_name);
 
-	/** The server name */
-	string server_name;
-	/** The client name (used in internal JACK representations) */
-	string client_name;
-
-        bool click_onset;
-        bool click_offset;
+        /** amplitude of clicks for onsets and offsets (0 to disable) */
+        sample_t click_onset;
+        sample_t click_offset;
 
 protected:
 
 	virtual void print_usage();
+        virtual void process_options();
 
 }; // jclicker_options
 
-static jclicker_options options(PROGRAM_NAME);
-static boost::shared_ptr<jack_client> client;
-jack_port_t *port_in, *port_out;
-static int ret = EXIT_SUCCESS;
-static int running = 1;
-
-int
-process(jack_client *client, nframes_t nframes, nframes_t)
-{
-	void *in = client->events(port_in, nframes);
-	sample_t *out = client->samples(port_out, nframes);
-
-        memset(out, 0, nframes * sizeof(sample_t));
-
-        jack_midi_event_t event;
-        nframes_t nevents = jack_midi_get_event_count(in);
-        for (nframes_t i = 0; i < nevents; ++i) {
-                jack_midi_event_get(&event, in, i);
-                if (event.size < 1) continue;
-                midi::data_type t = event.buffer[0] & midi::type_nib;
-                switch(t) {
-                case midi::stim_on:
-                case midi::note_on:
-                        if (options.count("no-onset")==0) {
-                                out[event.time] = options.click_onset * 1.0f;
-                        }
-                        break;
-                case midi::stim_off:
-                case midi::note_off:
-                        if (options.count("no-offset")==0) {
-                                out[event.time] = options.click_offset * 1.0f;
+/*
+ * Converts onset and offset events on the input to single-sample clicks on the
+ * output. The amplitudes are resolved from the options at startup.
+ */
+struct jclicker_kernel : module_kernel<void> {
+        sample_t const click_onset;
+        sample_t const click_offset;
+
+        jclicker_kernel(sample_t on, sample_t off) : click_onset(on), click_offset(off) {}
+
+        void operator()(std::size_t, midi_event_cache const & in, sample_t * out, nframes_t nframes) {
+                memset(out, 0, nframes * sizeof(sample_t));
+
+                for (midi_event_cache::const_iterator event = in.begin(); event != in.end(); ++event) {
+                        if (event->size < 1) continue;
+                        midi::data_type t = event->status & midi::type_nib;
+                        switch(t) {
+                        case midi::stim_on:
+                        case midi::note_on:
+                                out[event->time] = click_onset;
+                                break;
+                        case midi::stim_off:
+                        case midi::note_off:
+                                out[event->time] = click_offset;
+                        default:
+                                break;
                         }
-                default:
-                        break;
                 }
         }
+};
 
-        // this just copies data from input to output - replace with something
-        // more interesting
-
-        return 0;
-}
+static jclicker_options options(PROGRAM_NAME);
+static boost::shared_ptr<jack_client> client;
+static int ret = EXIT_SUCCESS;
+static int running = 1;
 
 /** handle server shutdowns */
 void
@@ -106,11 +95,9 @@ main(int argc, char **argv)
                 // start client
                 client.reset(new jack_client(options.client_name, options.server_name));
 
-                // register ports
-                port_in = client->register_port("in",JACK_DEFAULT_MIDI_TYPE,
-                                                JackPortIsInput, 0);
-                port_out = client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
-                                                 JackPortIsOutput, 0);
+                // register ports and process callback
+                jclicker_kernel kernel(options.click_onset, options.click_offset);
+                multichannel_module<jclicker_kernel> module(client.get(), kernel, options.nchannels);
 
                 // register signal handlers
 		signal(SIGINT,  signal_handler);
@@ -119,20 +106,12 @@ main(int argc, char **argv)
 
                 // register jack callbacks
                 client->set_shutdown_callback(jack_shutdown);
-                client->set_process_callback(process);
 
                 // activate client
                 client->activate();
 
                 // connect ports
-                if (options.count("in")) {
-                        stringvec const & portlist = options.vmap["in"].as<stringvec>();
-                        client->connect_ports(portlist.begin(), portlist.end(), "in");
-                }
-                if (options.count("out")) {
-                        stringvec const & portlist = options.vmap["out"].as<stringvec>();
-                        client->connect_ports("out", portlist.begin(), portlist.end());
-                }
+                module.connect_ports(options.input_ports, options.output_ports);
 
                 while (running) {
                         usleep(100000);
@@ -154,22 +133,8 @@ main(int argc, char **argv)
 
 /** configure commandline options */
 jclicker_options::jclicker_options(string const &program_name)
-        : program_options(program_name)
+        : multichannel_options(program_name)
 {
-
-        // this section is for general JILL options. try to maintain consistency
-        // with other modules
-        po::options_description jillopts("JILL options");
-        jillopts.add_options()
-                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
-                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
-                 "set client name")
-                ("in,i",      po::value<stringvec>(), "add connection to input port")
-                ("out,o",     po::value<stringvec>(), "add connection to output port");
-        cmd_opts.add(jillopts);
-        visible_opts.add(jillopts);
-
-
         // add section(s) for module-specific options
         po::options_description opts("jclicker options");
         opts.add_options()
@@ -180,16 +145,19 @@ jclicker_options::jclicker_options(string const &program_name)
         visible_opts.add(opts);
 }
 
+void
+jclicker_options::process_options()
+{
+        click_onset = count("no-onset") ? 0.0f : 1.0f;
+        click_offset = count("no-offset") ? 0.0f : 1.0f;
+}
+
 /** provide the user with some information about the ports */
 void
 jclicker_options::print_usage()
 {
         std::cout << _program_name << ": generate audible clicks for events\n\n"
                   << "Usage: " << _program_name << " [options]\n"
-                  << visible_opts << std::endl
-                  << "Ports:\n"
-                  << " * in:        input event port\n"
-                  << " * out:       output audio port\n"
-                  << std::endl;
+                  << visible_opts << std::endl;
+        print_ports("input event port", "output audio port");
 }
-
@@ -2,7 +2,7 @@
  * jfilter - filter the input data according to cutoff frequencies using
  * butterworth/custom method.
  *
-* This program is free software; you can redistribute it and/or modify
+ * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2 of the License, or
  * (at your option) any later version.
@@ -11,112 +11,90 @@
  */
 #include <iostream>
 #include <signal.h>
-#include <boost/shared_ptr.hpp>
-#include <boost/filesystem.hpp>
-#include <boost/lambda/lambda.hpp>
-#include <sstream>
 #include <algorithm>
+#include <boost/shared_ptr.hpp>
 
-#include "../jill/digital_filter.hh"
-#include "../jill/logging.hh"
-#include "../jill/jack_client.hh"
-#include "../jill/program_options.hh"
+#include "jill/digital_filter.hh"
+#include "jill/logging.hh"
+#include "jill/jack_client.hh"
+#include "jill/multichannel_module.hh"
+#include "jill/pipelined_kernel.hh"
 
 #define PROGRAM_NAME "jfilter"
 
-
 using namespace jill;
 using std::string;
-typedef std::vector<string> svec;
-typedef jack_client::port_list_type plist_t;
 typedef digital_filter::COEF_t COEF_t;
 
-class jfilter_options : public program_options {
+class jfilter_options : public multichannel_options {
 
 public:
-
         jfilter_options(string const &program_name);
 
-        string client_name;
-        string server_name;
-  
-        svec input_ports;
-        svec output_ports;
-  
-        int nports;
-
-        string filter_class;
         string filter_type;
         std::vector<COEF_t> cutoff_frequencies;
         int order;
 
         std::vector<COEF_t> numerator;
         std::vector<COEF_t> denominator;
-        
-        
-
-protected:
-        virtual void print_usage();
-};
-  
 
+        /* if true, filter on a worker thread with one period of latency */
+        bool pipeline;
 
+protected:
 
-static jfilter_options options(PROGRAM_NAME);
-static boost::shared_ptr<jack_client> client;
-static plist_t ports_in, ports_out;
-static int ret = EXIT_SUCCESS;
-static int running = 1;
-static unsigned int xrun = 0;
-
-
-static digital_filter filter; 
+        virtual void print_usage();
+        virtual void process_options();
 
+}; // jfilter_options
 
-int 
-process (jack_client *client, nframes_t nframes, nframes_t time)
-{
 
-        sample_t *in, *out;
-  
-        plist_t::const_iterator it_out = ports_out.begin();
-        for (plist_t::const_iterator it_in = ports_in.begin(); it_in != ports_in.end(); it_in++) { 
-                in = client->samples(*it_in, nframes);	  
-                if (in == 0) continue;
-                out = client->samples(*it_out, nframes);
-                filter.filter_buf(in, out, jack_port_name(*it_in), nframes);         
-                it_out++;
+/*
+ * Filters each channel, keeping the pads for each channel under its own name.
+ * Xruns are flagged by the xrun callback and handled by the kernel, so that
+ * the pads are only touched by the thread running the filter (which may be a
+ * pipeline worker).
+ */
+struct jfilter_kernel : module_kernel<sample_t> {
+        digital_filter & filter;
+        std::vector<string> names;
+        int reset;
+
+        jfilter_kernel(digital_filter & f) : filter(f), reset(0) {}
+
+        int buffer_size(std::size_t nchannels, nframes_t) {
+                char buf[32];
+                names.resize(nchannels);
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        sprintf(buf, "%03zu", c);
+                        names[c] = buf;
+                }
+                return 0;
         }
-  
-        return 0;      
-}
-
-
-/** this is called by jack when calculating latency */
-void
-jack_latency (jack_latency_callback_mode_t mode, void *arg)
-{
 
-}
-
-
-/** handle changes to buffer size */
-int
-jack_bufsize(jack_client *client, nframes_t nframes)
-{
+        void operator()(std::size_t chan, sample_t const * in, sample_t * out, nframes_t nframes) {
+                if (chan == 0 && __sync_bool_compare_and_swap(&reset, 1, 0))
+                        filter.reset_pads();
+                filter.filter_buf(in, out, names[chan], nframes);
+        }
 
+        /** Reset the filter pads before the next period */
+        void xrun() { __sync_lock_test_and_set(&reset, 1); }
+};
 
-        return 0;
-}
+static jfilter_options options(PROGRAM_NAME);
+static boost::shared_ptr<jack_client> client;
+static digital_filter filter;
+static jfilter_kernel kernel(filter);
+static int ret = EXIT_SUCCESS;
+static int running = 1;
 
 
 /** handle xrun events */
 int
 jack_xrun(jack_client *client, float delay)
 {
-        xrun++;
-        std::cout << "xrun: " << delay << std::endl;
-        filter.reset_pads();
+        kernel.xrun();
         return 0;
 }
 
@@ -125,13 +103,10 @@ jack_xrun(jack_client *client, float delay)
 void
 jack_shutdown(jack_status_t code, char const *msg)
 {
-        
         ret = -1;
         running = 0;
 }
 
-// jack_client::ShutdownCallback shutdown_callback = &jack_shutdown;
-//shutdown_callback = &jack_shutdown;
 
 /** handle POSIX signals */
 void
@@ -139,165 +114,84 @@ signal_handler(int sig)
 {
         ret = sig;
         running = 0;
-        exit(sig);
 }
 
 
+/** set up the client with kernel K and run until interrupted */
+template <typename K>
+int
+run_module(K & kernel)
+{
+        multichannel_module<K> module(client.get(), kernel, options.nchannels);
+
+        // register signal handlers
+        signal(SIGINT,  signal_handler);
+        signal(SIGTERM, signal_handler);
+        signal(SIGHUP,  signal_handler);
+
+        client->set_shutdown_callback(jack_shutdown);
+        client->set_xrun_callback(jack_xrun);
+        client->activate();
+        module.connect_ports(options.input_ports, options.output_ports);
 
-plist_t 
-create_ports(int nports, string const & base_name, string const & type,
-             unsigned long flags, unsigned long buffer_size=0) {
-        
-	svec port_names;
-	using std::stringstream;        
-        stringstream stream_idx;       
-        std::string port_string;
-        jack_port_t* p;
-        plist_t ports;
-
-        for (int i = 0; i <= nports; ++i) {
-                stream_idx << i + 1;
-                port_string = base_name + stream_idx.str();  
-		p = client->register_port(port_string, type, flags, buffer_size);
-                ports.push_back(p);
-                stream_idx.str("");             
+        while (running) {
+                usleep(100000);
         }
-	return ports;
+
+        client->deactivate();
+        return ret;
 }
 
 
+/** run kernel K, on a worker thread if requested */
+template <typename K>
+int
+run(K & kernel)
+{
+        if (options.pipeline) {
+                pipelined_kernel<K> pipelined(client.get(), kernel);
+                int r = run_module(pipelined);
+                LOG << "worker overruns: " << pipelined.overruns();
+                return r;
+        }
+        return run_module(kernel);
+}
+
 
-                   
 int
 main(int argc, char **argv)
 {
 	using namespace std;
-
 	try {
-                // parse options
-                
 		options.parse(argc,argv);
-
-                // start client
                 client.reset(new jack_client(options.client_name, options.server_name));
-          
 
                 // set filter coefficients
-
-                bool butter = (options.count("order") && 
-                               options.count("cutoff-frequencies") && 
+                bool butter = (options.count("order") &&
+                               options.count("cutoff-frequencies") &&
                                options.count("type")
                                ) && !(options.count("numerator") || options.count("denominator"));
-                bool custom =  !(options.count("order") || 
+                bool custom =  !(options.count("order") ||
                                options.count("cutoff-frequencies") ||
                                options.count("type")
                                ) && (options.count("numerator") && options.count("denominator"));
 
                 if (custom) {
                         filter.custom_coef(options.numerator,
-                                           options.denominator);                                                     
-                }               
+                                           options.denominator);
+                }
                 else if (butter) {
                         filter.butter(options.order,
                                       options.cutoff_frequencies,
                                       options.filter_type,
                                       client->sampling_rate());
-                } 
-                else {
-                            LOG << "ERROR: missing or incompatible arguments.";
-                            throw Exit(-1);
-                }
-
-
-                // register input ports
-                ports_in = create_ports(options.nports, "in_", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-                             
-                // register output ports 
-                ports_out = create_ports(options.nports, "out_", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-		
-                // const jack_port_t* p = client->get_port(ports_out[0]);                        
-                // std::cout << jack_port_name(p) << std::endl;
-                // std::cout << ports_out[0] << std::endl;
-
-                // register signal handlers
-		        signal(SIGINT,  signal_handler);
-                signal(SIGTERM, signal_handler);
-		        signal(SIGHUP,  signal_handler);
-
-                // register jack callbacks
-                client->set_shutdown_callback(jack_shutdown);
-                client->set_xrun_callback(jack_xrun);
-                client->set_process_callback(process);
-
-                // uncomment if you need these callbacks
-                // client->set_buffer_size_callback(jack_bufsize);
-                // jack_set_latency_callback (client->client(), jack_latency, 0);
-
-		
-                // activate client
-                client->activate();
-                
-
-                if (options.count("in")) {
-                        plist_t::const_iterator it_port = ports_in.begin();
-                        svec const & in_connections = options.vmap["in"].as<svec>();                        
-                        for (svec::const_iterator it_connect = in_connections.begin(); 
-                             it_connect != in_connections.end(); it_connect++) {
-
-                                jack_port_t *p = client->get_port(*it_connect);                               
-                                if (p==0) {
-                                        LOG << "error registering port: source port \""
-                                        << *it_connect << "\" does not exist";
-                                        throw Exit(-1);
-                                }
-                                else if (!(jack_port_flags(p) & JackPortIsOutput)) {
-                                        LOG << "error registering port: source port \""
-                                            << *it_connect << "\" is not an output port";
-                                        throw Exit(-1);
-                                }
-                                else {
-                                        client->connect_port(*it_connect, 
-                                                             jack_port_name(*it_port));
-                        
-                                }
-                                it_port++;        
-                        }
                 }
-
-                if (options.count("out")) {
-                        plist_t::const_iterator it_port = ports_out.begin();
-                        svec const & out_connections = options.vmap["out"].as<svec>();                        
-                        for (svec::const_iterator it_connect = out_connections.begin(); 
-                             it_connect != out_connections.end(); it_connect++) {
-
-                                jack_port_t *p = client->get_port(*it_connect);                               
-                                if (p==0) {
-                                        LOG << "error registering port: destination port \""
-                                        << *it_connect << "\" does not exist";
-                                        throw Exit(-1);
-                                }
-                                else if (!(jack_port_flags(p) & JackPortIsInput)) {
-                                        LOG << "error registering port: destination port \""
-                                            << *it_connect << "\" is not an input port";
-                                        throw Exit(-1);
-                                }
-                                else {
-                                        client->connect_port(jack_port_name(*it_port), 
-                                                             *it_connect);
-                        
-                                }
-                                it_port++;        
-                        }
+                else {
+                        LOG << "ERROR: missing or incompatible arguments.";
+                        throw Exit(-1);
                 }
 
-
-                while (running) {
-                        usleep(100000);
-
-                }
-  
-                client->deactivate();
-		return EXIT_SUCCESS;
+                return run(kernel);
 	}
 
 	/*
@@ -319,44 +213,41 @@ main(int argc, char **argv)
 }
 
 
-jfilter_options::jfilter_options(string const &program_name) 
-: program_options(program_name)
+jfilter_options::jfilter_options(string const &program_name)
+        : multichannel_options(program_name)
 {
         using namespace std;
-        po::options_description jillopts("JILL options");
-        jillopts.add_options()
-                ("server,s",    po::value<string>(&server_name), "connect to specific jack server")
-                ("name,n",      po::value<string>(&client_name)->default_value(PROGRAM_NAME), 
-                 "set filtering client name")
-                ("in,i",        po::value<vector<string> >(&input_ports), "add connections to input ports of jfilter")
-                ("out,o",       po::value<vector<string> >(&output_ports), "add connections to output ports of jfilter")
-                ("ports,p",     po::value<int>(&nports)->default_value(1), "number of jfilter ports to create.\n If less than number of connections, additional ports will be created.");
-                                            
-  
-        options.nports =  max(options.nports, max(options.count("in"), options.count("out"))); 
         po::options_description opts("Filter options");
         opts.add_options()
-                ("numerator",   po::value<vector<COEF_t> >(&numerator)->multitoken(), 
+                ("numerator",   po::value<vector<COEF_t> >(&numerator)->multitoken(),
                  "Set custom numerator coefficients of filter.")
-                ("denominator", po::value<vector<COEF_t> >(&denominator)->multitoken(), 
-                 "Set custom denominator coefficients of filter")        
-                // ("class,c", po::value<string>(&filter_class)->default_value("butterworth"), "Class of filter.  Available classes: butterworth")
-                ("type,t", po::value<string>(&filter_type)->default_value("low-pass"), "Filter type. Available types: low-pass, high-pass, band-pass, band-stop")
-                ("cutoff-frequencies,f", po::value<vector<COEF_t> >(&cutoff_frequencies)->multitoken(), "Cutoff frequencies")
-                ("order,O", po::value<int>(&order), "Filter order (number of poles).");
-
+                ("denominator", po::value<vector<COEF_t> >(&denominator)->multitoken(),
+                 "Set custom denominator coefficients of filter")
+                ("type,t", po::value<string>(&filter_type)->default_value("low-pass"),
+                 "Filter type. Available types: low-pass, high-pass, band-pass, band-stop")
+                ("cutoff-frequencies,f", po::value<vector<COEF_t> >(&cutoff_frequencies)->multitoken(),
+                 "Cutoff frequencies")
+                ("order,O", po::value<int>(&order), "Filter order (number of poles).")
+                ("pipeline", "filter on a worker thread (adds one period of latency)");
+
+        cmd_opts.add(opts);
+        visible_opts.add(opts);
+}
 
-        cmd_opts.add(jillopts).add(opts);
-        visible_opts.add(jillopts).add(opts);
 
+void
+jfilter_options::process_options()
+{
+        assign(pipeline, "pipeline");
+        // each connection gets its own channel, as before the port to multichannel_module
+        nchannels = std::max(nchannels, std::max(input_ports.size(), output_ports.size()));
 }
 
+
 void
 jfilter_options::print_usage()
 {
-  std::cout << "Usage: " << _program_name << " [options]\n" 
-            << visible_opts << std::endl
-            << "Ports \n"
-            << " * in: \t input port" << std::endl
-            << " * out: \t output port with filtered signal" << std::endl;
+        std::cout << "Usage: " << _program_name << " [options]\n"
+                  << visible_opts << std::endl;
+        print_ports("input port", "output port with filtered signal");
 }
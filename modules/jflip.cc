@@ -11,93 +11,82 @@
 #include <iostream>
 #include <signal.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
 
-#include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 #include <stdexcept>
+#include <algorithm>
 
 #include "jill/logging.hh"
 #include "jill/jack_client.hh"
-#include "jill/program_options.hh"
+#include "jill/multichannel_module.hh"
 
 #define PROGRAM_NAME "jflip"
 
 using namespace jill;
 using std::string;
-typedef std::vector<string> stringvec;
 
-class jflip_options : public program_options {
+class jflip_options : public multichannel_options {
 
 public:
     jflip_options(string const &program_name);
 
-    /** The server name */
-    string server_name;
-    /** The client name (used in internal JACK representations) */
-    string client_name;
-
 protected:
 
     virtual void print_usage();
 
 }; // jflip_options
 
+/*
+ * Inverts each sample with probability 1/2. Each call to the xorshift generator
+ * yields 32 coin flips, which are used as a sign mask so the inner loop has no
+ * branches or library calls. Each channel has its own generator state.
+ */
+struct jflip_kernel : module_kernel<sample_t> {
+        std::vector<boost::uint32_t> state;
+
+        jflip_kernel(boost::uint32_t seed) : _seed(seed | 1) {}
+
+        int buffer_size(std::size_t nchannels, nframes_t) {
+                // only seeds on the first call, so the sequence continues
+                // across period size changes
+                if (state.size() != nchannels) {
+                        state.resize(nchannels);
+                        for (std::size_t c = 0; c < nchannels; ++c)
+                                state[c] = _seed + 0x9e3779b9U * c;
+                }
+                return 0;
+        }
+
+        void operator()(std::size_t chan, sample_t const * JILL_RESTRICT in,
+                        sample_t * JILL_RESTRICT out, nframes_t nframes) {
+                boost::uint32_t x = state[chan];
+                for (nframes_t i = 0; i < nframes; i += 32) {
+                        x ^= x << 13;
+                        x ^= x >> 17;
+                        x ^= x << 5;
+                        nframes_t n = std::min<nframes_t>(32, nframes - i);
+                        for (nframes_t j = 0; j < n; ++j) {
+                                // 1.0 or -1.0 depending on bit j
+                                sample_t sign = 1.0f - 2.0f * ((x >> j) & 1U);
+                                out[i + j] = in[i + j] * sign;
+                        }
+                }
+                state[chan] = x;
+        }
+
+private:
+        boost::uint32_t _seed;
+};
+
 static jflip_options options(PROGRAM_NAME);
 static boost::shared_ptr<jack_client> client;
-jack_port_t *port_in, *port_out;
 static int ret = EXIT_SUCCESS;
 static int running = 1;
 static int stopping = 0;
 static int xruns = 0;
 
 
-int
-process(jack_client *client, nframes_t nframes, nframes_t)
-{
-    sample_t *in = client->samples(port_in, nframes);
-    sample_t *out = client->samples(port_out, nframes);
-
-    nframes_t inputSize = nframes;
-
-    memcpy(out, in, nframes * sizeof(sample_t));
-    int i = 0;
-    std::srand(std::time(NULL));
-    while( i < inputSize) { 
-        int coin = rand()%2;
-        if (coin == 0) {
-            *(out+i) *= -1;
-        }
-        i++;
-    }
-
-        return 0;
-}
-
-
-/** this is called by jack when calculating latency */
-void
-jack_latency (jack_latency_callback_mode_t mode, void *arg)
-{
-    jack_latency_range_t range;
-        jack_port_get_latency_range (port_in, mode, &range);
-    if (mode == JackCaptureLatency) {
-                // add latency between inputs and outputs
-    }
-        else {
-                // add latency between output and input
-    }
-        jack_port_set_latency_range (port_out, mode, &range);
-}
-
-
-/** handle changes to buffer size */
-int
-jack_bufsize(jack_client *client, nframes_t nframes)
-{
-        return 0;
-}
-
-
 /** handle xrun events */
 int
 jack_xrun(jack_client *client, float delay)
@@ -135,41 +124,29 @@ main(int argc, char **argv)
     using namespace std;
     try {
                 // parse options
-        options.parse(argc,argv);
+                options.parse(argc,argv);
 
                 // start client
                 client.reset(new jack_client(options.client_name, options.server_name));
 
-                // register ports
-                port_in = client->register_port("in",JACK_DEFAULT_AUDIO_TYPE,
-                                                JackPortIsInput, 0);
-                port_out = client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
-                                                 JackPortIsOutput, 0);
+                // register ports and process callback
+                jflip_kernel kernel(std::time(NULL));
+                multichannel_module<jflip_kernel> module(client.get(), kernel, options.nchannels);
 
                 // register signal handlers
-        signal(SIGINT,  signal_handler);
-        signal(SIGTERM, signal_handler);
-        signal(SIGHUP,  signal_handler);
+                signal(SIGINT,  signal_handler);
+                signal(SIGTERM, signal_handler);
+                signal(SIGHUP,  signal_handler);
 
                 // register jack callbacks
                 client->set_shutdown_callback(jack_shutdown);
                 client->set_xrun_callback(jack_xrun);
-                client->set_process_callback(process);
-
-                client->set_buffer_size_callback(jack_bufsize);
 
                 // activate client
                 client->activate();
 
                 // connect ports
-                if (options.count("in")) {
-                        stringvec const & portlist = options.vmap["in"].as<stringvec>();
-                        client->connect_ports(portlist.begin(), portlist.end(), "in");
-                }
-                if (options.count("out")) {
-                        stringvec const & portlist = options.vmap["out"].as<stringvec>();
-                        client->connect_ports("out", portlist.begin(), portlist.end());
-                }
+                module.connect_ports(options.input_ports, options.output_ports);
 
                 while (running) {
                         usleep(100000);
@@ -200,23 +177,8 @@ main(int argc, char **argv)
 
 /** configure commandline options */
 jflip_options::jflip_options(string const &program_name)
-        : program_options(program_name)
+        : multichannel_options(program_name)
 {
-
-        // this section is for general JILL options. try to maintain consistency
-        // with other modules
-        po::options_description jillopts("JILL options");
-        jillopts.add_options()
-                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
-                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
-                 "set client name")
-                ("in,i",      po::value<stringvec>(), "add connection to input port")
-                ("out,o",     po::value<stringvec>(), "add connection to output port")
-                ;
-        cmd_opts.add(jillopts);
-        // cfg_opts.add(jillopts);
-        visible_opts.add(jillopts);
-
 }
 
 
@@ -225,10 +187,6 @@ void
 jflip_options::print_usage()
 {
         std::cout << "Usage: " << _program_name << " [options]\n"
-                  << visible_opts << std::endl
-                  << "Ports:\n"
-                  << " * in:        input port\n"
-                  << " * out:       output port\n"
-                  << std::endl;
+                  << visible_opts << std::endl;
+        print_ports("input port", "output port");
 }
-
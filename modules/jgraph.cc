@@ -0,0 +1,421 @@
+/*
+ * jgraph - run a chain of processing steps in a single client
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
+#include <iostream>
+#include <signal.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "jill/logging.hh"
+#include "jill/jack_client.hh"
+#include "jill/program_options.hh"
+#include "jill/multichannel_module.hh"
+#include "jill/processing_graph.hh"
+#include "jill/digital_filter.hh"
+#include "jill/midi.hh"
+#include "jill/dsp/ringbuffer.hh"
+#include "jill/dsp/crossing_trigger.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+#include "jill/dsp/triggered_data_writer.hh"
+#include "jill/dsp/threshold_gate.hh"
+#include "jill/file/arf_writer.hh"
+
+#define PROGRAM_NAME "jgraph"
+
+using namespace jill;
+using std::string;
+typedef std::vector<string> svec;
+
+class jgraph_options : public program_options {
+
+public:
+	jgraph_options(string const &program_name);
+
+        string server_name;
+	string client_name;
+
+        /** node definitions: name -> type:source,source,... */
+        std::map<string, string> nodes;
+        /** input port connections: input -> port */
+        std::map<string, string> input_connections;
+        /** output port connections: node -> port */
+        std::map<string, string> output_connections;
+
+        /* filter nodes */
+        string filter_type;
+        std::vector<double> cutoff_frequencies;
+        int filter_order;
+
+        /* detector nodes */
+        float period_size_ms;
+        float open_threshold;
+        float open_crossing_rate;
+        float open_crossing_period_ms;
+        float close_threshold;
+        float close_crossing_rate;
+        float close_crossing_period_ms;
+
+        /* delay nodes */
+        float delay_msec;
+
+        /* gate nodes */
+        float gate_threshold;
+        bool gate_reverse;
+
+        /* recorder node */
+        string output_file;
+        string record_trigger;
+        float pretrigger_size_s;
+        float posttrigger_size_s;
+        int compression;
+        std::map<string, string> attrs;
+
+protected:
+
+	virtual void print_usage();
+        virtual void process_options();
+
+}; // jgraph_options
+
+
+/* applies a butterworth filter (see jfilter) */
+class filter_node : public graph_node {
+public:
+        filter_node(string const & name, jgraph_options const & o, nframes_t srate)
+                : _name(name) {
+                _filter.butter(o.filter_order, o.cutoff_frequencies, o.filter_type, srate);
+        }
+        void process(node_io & io, nframes_t nframes, nframes_t) {
+                _filter.filter_buf(io.inputs[0].samples, io.samples, _name, nframes);
+        }
+        void xrun() { _filter.reset_pads(); }
+private:
+        string const _name;
+        digital_filter _filter;
+};
+
+/* emits onset and offset events when the signal crosses thresholds (see jdetect) */
+class detector_node : public graph_node {
+public:
+        detector_node(jgraph_options const & o, nframes_t srate) {
+                nframes_t period_size = o.period_size_ms * srate / 1000;
+                int open_periods = o.open_crossing_period_ms / o.period_size_ms;
+                int close_periods = o.close_crossing_period_ms / o.period_size_ms;
+                int open_count = o.open_crossing_rate * period_size / 1000 * open_periods;
+                int close_count = o.close_crossing_rate * period_size / 1000 * close_periods;
+                _trigger.reset(new dsp::crossing_trigger<sample_t>(o.open_threshold, open_count,
+                                                                   open_periods,
+                                                                   o.close_threshold, close_count,
+                                                                   close_periods, period_size));
+        }
+        output_type output() const { return EVENTS; }
+        void process(node_io & io, nframes_t nframes, nframes_t) {
+                int offset = _trigger->push(io.inputs[0].samples, nframes);
+                if (offset < 0) return;
+                jack_midi_data_t buf[] = { midi::default_channel, midi::default_pitch,
+                                           midi::default_velocity };
+                buf[0] += (_trigger->open()) ? midi::note_on : midi::note_off;
+                jack_midi_event_write(io.events, offset, buf, 3);
+        }
+private:
+        boost::scoped_ptr<dsp::crossing_trigger<sample_t> > _trigger;
+};
+
+/* inserts a fixed delay (see jdelay) */
+class delay_node : public graph_node {
+public:
+        delay_node(nframes_t delay) : _delay(delay), _ringbuf(1024) {}
+        void process(node_io & io, nframes_t nframes, nframes_t) {
+                _ringbuf.push(io.inputs[0].samples, nframes);
+                _ringbuf.pop(io.samples, nframes);
+        }
+        int buffer_size(nframes_t nframes) {
+                _ringbuf.resize(_delay + nframes);
+                _ringbuf.pop(0);
+                _ringbuf.push(0, _delay);
+                return 0;
+        }
+        nframes_t latency() const { return _delay; }
+private:
+        nframes_t const _delay;
+        dsp::ringbuffer<sample_t> _ringbuf;
+};
+
+/* passes samples above a threshold, or below it if reversed (see jpop) */
+class gate_node : public graph_node {
+public:
+        gate_node(dsp::threshold_gate::mode_type mode, sample_t thresh)
+                : _gate(mode, thresh), _state(dsp::threshold_gate::initial_state()) {}
+        void process(node_io & io, nframes_t nframes, nframes_t) {
+                _gate.process(_state, io.inputs[0].samples, io.samples, nframes);
+        }
+private:
+        dsp::threshold_gate const _gate;
+        dsp::threshold_gate::state _state;
+};
+
+/* passes its sources to a disk thread (see jrecord) */
+class record_node : public graph_node {
+public:
+        record_node(boost::shared_ptr<dsp::buffered_data_writer> writer) : _writer(writer) {}
+        output_type output() const { return NONE; }
+        bool accepts_events() const { return true; }
+        void process(node_io & io, nframes_t nframes, nframes_t time) {
+                jack_midi_event_t event;
+                for (std::vector<node_io::source>::const_iterator it = io.inputs.begin();
+                     it != io.inputs.end(); ++it) {
+                        if (it->samples) {
+                                _writer->push(time, SAMPLED, it->name.c_str(),
+                                              nframes * sizeof(sample_t), it->samples);
+                                continue;
+                        }
+                        nframes_t nevents = jack_midi_get_event_count(it->events);
+                        for (nframes_t j = 0; j < nevents; ++j) {
+                                jack_midi_event_get(&event, it->events, j);
+                                if (event.size == 0) continue;
+                                _writer->push(time + event.time, EVENT, it->name.c_str(),
+                                              event.size, event.buffer);
+                        }
+                }
+                _writer->data_ready();
+        }
+        void xrun() { _writer->xrun(); }
+private:
+        boost::shared_ptr<dsp::buffered_data_writer> _writer;
+};
+
+static jgraph_options options(PROGRAM_NAME);
+static boost::shared_ptr<jack_client> client;
+static boost::shared_ptr<dsp::buffered_data_writer> arf_thread;
+static int ret = EXIT_SUCCESS;
+static int running = 1;
+
+
+void
+jack_shutdown(jack_status_t code, char const *)
+{
+        ret = -1;
+        running = 0;
+}
+
+void
+signal_handler(int sig)
+{
+        ret = sig;
+        running = 0;
+}
+
+/** create a node from its type */
+graph_node *
+make_node(string const & name, string const & type)
+{
+        nframes_t srate = client->sampling_rate();
+        if (type == "filter") {
+                return new filter_node(name, options, srate);
+        }
+        else if (type == "detect") {
+                return new detector_node(options, srate);
+        }
+        else if (type == "delay") {
+                return new delay_node(options.delay_msec * srate / 1000);
+        }
+        else if (type == "gate") {
+                return new gate_node(options.gate_reverse ? dsp::threshold_gate::BELOW
+                                     : dsp::threshold_gate::ABOVE, options.gate_threshold);
+        }
+        else if (type == "record") {
+                if (arf_thread) {
+                        LOG << "ERROR: only one record node is supported";
+                        throw Exit(EXIT_FAILURE);
+                }
+                if (options.output_file.empty()) {
+                        LOG << "ERROR: record node requires an output file";
+                        throw Exit(EXIT_FAILURE);
+                }
+                boost::shared_ptr<data_writer> writer(
+                        new file::arf_writer(options.output_file, *client, options.attrs,
+                                             options.compression));
+                if (options.record_trigger.empty()) {
+                        LOG << "recording will be continuous";
+                        arf_thread.reset(new dsp::buffered_data_writer(writer));
+                }
+                else {
+                        LOG << "recordings will be triggered by " << options.record_trigger;
+                        arf_thread.reset(new dsp::triggered_data_writer(
+                                                 writer, options.record_trigger,
+                                                 options.pretrigger_size_s * srate,
+                                                 options.posttrigger_size_s * srate));
+                }
+                // enough room for 2 seconds of every channel
+                arf_thread->request_buffer_size(2 * srate * options.nodes.size() *
+                                                sizeof(sample_t));
+                return new record_node(arf_thread);
+        }
+        LOG << "ERROR: unknown node type " << type << " for " << name;
+        throw Exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	using namespace std;
+	try {
+		options.parse(argc,argv);
+                client.reset(new jack_client(options.client_name, options.server_name));
+
+                processing_graph graph(client.get());
+                graph.add_input("in");
+                for (map<string,string>::const_iterator it = options.nodes.begin();
+                     it != options.nodes.end(); ++it) {
+                        string::size_type colon = it->second.find(':');
+                        svec sources;
+                        if (colon != string::npos) {
+                                string srcs = it->second.substr(colon + 1);
+                                boost::split(sources, srcs, boost::is_any_of(","),
+                                             boost::token_compress_on);
+                        }
+                        graph_node * node = make_node(it->first, it->second.substr(0, colon));
+                        graph.add_node(it->first, node, sources);
+                        LOG << "node " << it->first << ": " << it->second;
+                }
+                graph.start();
+
+                // register signal handlers
+		signal(SIGINT,  signal_handler);
+		signal(SIGTERM, signal_handler);
+		signal(SIGHUP,  signal_handler);
+
+                client->set_shutdown_callback(jack_shutdown);
+                client->activate();
+                if (arf_thread) arf_thread->start();
+
+                for (map<string,string>::const_iterator it = options.input_connections.begin();
+                     it != options.input_connections.end(); ++it) {
+                        client->connect_port(it->second, it->first);
+                }
+                for (map<string,string>::const_iterator it = options.output_connections.begin();
+                     it != options.output_connections.end(); ++it) {
+                        client->connect_port(it->first, it->second);
+                }
+
+                while (running) {
+                        usleep(100000);
+                }
+
+                client->deactivate();
+                if (arf_thread) {
+                        arf_thread->stop();
+                        arf_thread->join();
+                }
+		return ret;
+	}
+	catch (Exit const &e) {
+		return e.status();
+	}
+	catch (std::exception const &e) {
+                LOG << "ERROR: " << e.what();
+		return EXIT_FAILURE;
+	}
+}
+
+
+jgraph_options::jgraph_options(string const &program_name)
+        : program_options(program_name)
+{
+        po::options_description jillopts("JILL options");
+        jillopts.add_options()
+                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
+                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
+                 "set client name")
+                ("node",      po::value<svec>(),
+                 "add a processing node (name=type:source,...)")
+                ("in,i",      po::value<svec>(), "connect the input (in=port)")
+                ("out,o",     po::value<svec>(), "connect the output of a node (node=port)");
+
+        po::options_description filtopts("Filter nodes");
+        filtopts.add_options()
+                ("filter-type", po::value<string>(&filter_type)->default_value("low-pass"),
+                 "filter type (low-pass, high-pass, band-pass, band-stop)")
+                ("cutoff-frequencies", po::value<std::vector<double> >(&cutoff_frequencies)->multitoken(),
+                 "cutoff frequencies")
+                ("order", po::value<int>(&filter_order)->default_value(4), "filter order");
+
+        po::options_description detopts("Detect nodes");
+        detopts.add_options()
+                ("period-size", po::value<float>(&period_size_ms)->default_value(20),
+                 "set analysis period size (ms)")
+                ("open-thresh", po::value<float>(&open_threshold)->default_value(0.01),
+                 "set sample threshold for open gate (0-1.0)")
+                ("open-rate", po::value<float>(&open_crossing_rate)->default_value(20),
+                 "set crossing rate thresh for open gate (s^-1)")
+                ("open-period", po::value<float>(&open_crossing_period_ms)->default_value(500),
+                 "set integration time for open gate (ms)")
+                ("close-thresh", po::value<float>(&close_threshold)->default_value(0.01),
+                 "set sample threshold for close gate")
+                ("close-rate", po::value<float>(&close_crossing_rate)->default_value(2),
+                 "set crossing rate thresh for close gate (s^-1)")
+                ("close-period", po::value<float>(&close_crossing_period_ms)->default_value(5000),
+                 "set integration time for close gate (ms)");
+
+        po::options_description miscopts("Delay and gate nodes");
+        miscopts.add_options()
+                ("delay", po::value<float>(&delay_msec)->default_value(10),
+                 "delay to add between input and output (ms)")
+                ("threshold", po::value<float>(&gate_threshold)->default_value(.75),
+                 "threshold of signal value below which samples are set to 0")
+                ("reverse", "zero samples above the threshold instead");
+
+        po::options_description recopts("Record node");
+        recopts.add_options()
+                ("output-file,f", po::value<string>(&output_file), "output filename")
+                ("attr,a", po::value<svec>(),
+                 "set additional attributes for recorded entries (key=value)")
+                ("trigger", po::value<string>(&record_trigger),
+                 "trigger recording with the events from this detect node")
+                ("pretrigger", po::value<float>(&pretrigger_size_s)->default_value(1.0),
+                 "duration to record before onset trigger (s)")
+                ("posttrigger", po::value<float>(&posttrigger_size_s)->default_value(0.5),
+                 "duration to record after offset trigger (s)")
+                ("compression", po::value<int>(&compression)->default_value(0),
+                 "set compression in output file (0-9)");
+
+        cmd_opts.add(jillopts).add(filtopts).add(detopts).add(miscopts).add(recopts);
+        visible_opts.add(jillopts).add(filtopts).add(detopts).add(miscopts).add(recopts);
+}
+
+void
+jgraph_options::process_options()
+{
+        program_options::process_options();
+        parse_keyvals(nodes, "node");
+        parse_keyvals(input_connections, "in");
+        parse_keyvals(output_connections, "out");
+        parse_keyvals(attrs, "attr");
+        assign(gate_reverse, "reverse");
+        if (nodes.empty()) {
+                LOG << "ERROR: no processing nodes defined";
+                throw Exit(EXIT_FAILURE);
+        }
+}
+
+void
+jgraph_options::print_usage()
+{
+        std::cout << "Usage: " << _program_name << " [options]\n"
+                  << visible_opts << std::endl
+                  << "Nodes are defined with --node name=type:source,... where type is\n"
+                  << "filter, detect, delay, gate, or record, and each source is 'in' or\n"
+                  << "the name of another node. Nodes are run in dependency order.\n\n"
+                  << "Ports:\n"
+                  << " * in:       sampled input\n"
+                  << " * NAME:     the output of each node (events for detect nodes)\n"
+                  << std::endl;
+}
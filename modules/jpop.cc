@@ -1,97 +1,74 @@
+/*
+ * jpop - zero out samples that don't cross a threshold
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
 #include <signal.h>
 #include <boost/shared_ptr.hpp>
-#include <boost/filesystem.hpp>
-#include <boost/function.hpp>
 #include <iostream>
+#include <vector>
 
-#include "../jill/logging.hh"
-#include "../jill/jack_client.hh"
-#include "../jill/program_options.hh"
+#include "jill/logging.hh"
+#include "jill/jack_client.hh"
+#include "jill/multichannel_module.hh"
+#include "jill/dsp/threshold_gate.hh"
 
 #define PROGRAM_NAME "jpop"
 
 using namespace jill;
 using std::string;
-typedef std::vector<string> stringvec;
 
-class jpop_options : public program_options {
+class jpop_options : public multichannel_options {
 
 public:
 	jpop_options(string const &program_name);
 
-	/** The server name */
-	string server_name;
-	/** The client name (used in internal JACK representations) */
-	string client_name;
-        
         /* threshold for below which signals are zeroed out */
         float threshold;
+        /* which samples pass the gate (above, below, or abs) */
+        dsp::threshold_gate::mode_type mode;
+        /* how far past the threshold a sample must go to close the gate */
+        float hysteresis;
+        /* gain ramp times when the gate opens and closes (ms) */
+        float attack_ms;
+        float release_ms;
 
 protected:
 
 	virtual void print_usage();
+        virtual void process_options();
 
 }; // jpop_options
 
-static jpop_options options(PROGRAM_NAME);
-static boost::shared_ptr<jack_client> client;
-jack_port_t *port_in, *port_out;
-static int ret = EXIT_SUCCESS;
-static int running = 1;
+/*
+ * Gates each channel with its own state. The mode and ramps are resolved when
+ * the gate is constructed, so the process loop doesn't branch on the options.
+ */
+struct jpop_kernel : module_kernel<sample_t> {
+        dsp::threshold_gate const gate;
+        std::vector<dsp::threshold_gate::state> states;
 
+        jpop_kernel(dsp::threshold_gate const & g) : gate(g) {}
 
-int
-process(jack_client *client, nframes_t nframes, nframes_t time)
-{
-	sample_t *in = client->samples(port_in, nframes);
-	sample_t *out = client->samples(port_out, nframes);
-
-        memset(out, (sample_t ) 0, nframes * sizeof(sample_t));
-        for (int i = 0; i < nframes; i++) {
-                if (in[i] > options.threshold && !options.count("reverse")) {
-                        out[i] = in[i];               
-                }    
-                else if (in[i] < options.threshold && options.count("reverse")) {
-                        out[i] = in[i];
-                }        
+        int buffer_size(std::size_t nchannels, nframes_t) {
+                states.resize(nchannels, dsp::threshold_gate::initial_state());
+                return 0;
         }
-                
-
-
-        return 0;
-}
-
-
-/** this is called by jack when calculating latency */
-void
-jack_latency (jack_latency_callback_mode_t mode, void *arg)
-{
-	jack_latency_range_t range;
-        jack_port_get_latency_range (port_in, mode, &range);
-	if (mode == JackCaptureLatency) {
-                // add latency between inputs and outputs
-	}
-        else {
-                // add latency between output and input
-	}
-        jack_port_set_latency_range (port_out, mode, &range);
-}
-
-
-/** handle changes to buffer size */
-int
-jack_bufsize(jack_client *client, nframes_t nframes)
-{
-        return 0;
-}
 
+        void operator()(std::size_t chan, sample_t const * in, sample_t * out, nframes_t nframes) {
+                gate.process(states[chan], in, out, nframes);
+        }
+};
 
-/** handle xrun events */
-int
-jack_xrun(jack_client *client, float delay)
-{
-        return 0;
-}
+static jpop_options options(PROGRAM_NAME);
+static boost::shared_ptr<jack_client> client;
+static int ret = EXIT_SUCCESS;
+static int running = 1;
 
 
 /** handle server shutdowns */
@@ -112,57 +89,44 @@ signal_handler(int sig)
 }
 
 
+/** set up the client with the kernel and run until interrupted */
+int
+run_module(jpop_kernel & kernel)
+{
+        multichannel_module<jpop_kernel> module(client.get(), kernel, options.nchannels);
+
+        // register signal handlers
+        signal(SIGINT,  signal_handler);
+        signal(SIGTERM, signal_handler);
+        signal(SIGHUP,  signal_handler);
+
+        client->set_shutdown_callback(jack_shutdown);
+        client->activate();
+        module.connect_ports(options.input_ports, options.output_ports);
+
+        while (running) {
+                usleep(100000);
+        }
+
+        client->deactivate();
+        return ret;
+}
+
+
 int
 main(int argc, char **argv)
 {
 	using namespace std;
 	try {
-                // parse options
 		options.parse(argc,argv);
-
-                cout <<   options.count("reverse")<< endl;
-                // start client
                 client.reset(new jack_client(options.client_name, options.server_name));
 
-                // register ports
-                port_in = client->register_port("in",JACK_DEFAULT_AUDIO_TYPE,
-                                                JackPortIsInput, 0);
-                port_out = client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
-                                                 JackPortIsOutput, 0);
-
-                // register signal handlers
-		signal(SIGINT,  signal_handler);
-		signal(SIGTERM, signal_handler);
-		signal(SIGHUP,  signal_handler);
-
-                // register jack callbacks
-                client->set_shutdown_callback(jack_shutdown);
-                client->set_xrun_callback(jack_xrun);
-                client->set_process_callback(process);
-
-                // uncomment if you need these callbacks
-                // client->set_buffer_size_callback(jack_bufsize);
-                // jack_set_latency_callback (client->client(), jack_latency, 0);
-
-                // activate client
-                client->activate();
-
-                // connect ports
-                if (options.count("in")) {
-                        stringvec const & portlist = options.vmap["in"].as<stringvec>();
-                        client->connect_ports(portlist.begin(), portlist.end(), "in");
-                }
-                if (options.count("out")) {
-                        stringvec const & portlist = options.vmap["out"].as<stringvec>();
-                        client->connect_ports("out", portlist.begin(), portlist.end());
-                }
-
-                while (running) {
-                        usleep(100000);
-                }
-
-                client->deactivate();
-		return ret;
+                nframes_t srate = client->sampling_rate();
+                dsp::threshold_gate gate(options.mode, options.threshold, options.hysteresis,
+                                         options.attack_ms * srate / 1000,
+                                         options.release_ms * srate / 1000);
+                jpop_kernel kernel(gate);
+                return run_module(kernel);
 	}
 
 	/*
@@ -186,45 +150,57 @@ main(int argc, char **argv)
 
 /** configure commandline options */
 jpop_options::jpop_options(string const &program_name)
-        : program_options(program_name)
+        : multichannel_options(program_name)
 {
-
-        // this section is for general JILL options. try to maintain consistency
-        // with other modules
-        po::options_description jillopts("JILL options");
-        jillopts.add_options()
-                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
-                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
-                 "set client name")
-                ("in,i",      po::value<stringvec>(), "add connection to input port")
-                ("out,o",     po::value<stringvec>(), "add connection to output port");
-        cmd_opts.add(jillopts);
-        visible_opts.add(jillopts);
-
-
-
         po::options_description opts("module options");
         opts.add_options()
                 ("threshold,t", po::value<float>(&threshold)->default_value(.75),
                  "threshold of signal value below which samples are set to 0")
-                ("reverse,r", "reverse");
-  
-
+                ("mode,m", po::value<string>()->default_value("above"),
+                 "pass samples above the threshold, below it, or with abs value above it (above|below|abs)")
+                ("reverse,r", "zero samples above the threshold instead (same as --mode below)")
+                ("hysteresis", po::value<float>(&hysteresis)->default_value(0),
+                 "distance back past the threshold needed to close the gate")
+                ("attack", po::value<float>(&attack_ms)->default_value(0),
+                 "time for the gain to ramp up when the gate opens (ms)")
+                ("release", po::value<float>(&release_ms)->default_value(0),
+                 "time for the gain to ramp down when the gate closes (ms)");
 
         cmd_opts.add(opts);
         visible_opts.add(opts);
 }
 
 
+void
+jpop_options::process_options()
+{
+        if (vmap.count("reverse"))
+                mode = dsp::threshold_gate::BELOW;
+        else {
+                try {
+                        mode = dsp::threshold_gate::parse_mode(get<string>("mode"));
+                }
+                catch (std::invalid_argument const & e) {
+                        LOG << "ERROR: " << e.what();
+                        throw Exit(EXIT_FAILURE);
+                }
+        }
+        if (hysteresis < 0 || attack_ms < 0 || release_ms < 0) {
+                LOG << "ERROR: hysteresis, attack, and release must be >= 0";
+                throw Exit(EXIT_FAILURE);
+        }
+        LOG << "threshold: " << threshold << " (" << dsp::threshold_gate::mode_name(mode) << ")";
+        if (hysteresis > 0) LOG << "hysteresis: " << hysteresis;
+        if (attack_ms > 0 || release_ms > 0)
+                LOG << "attack: " << attack_ms << " ms, release: " << release_ms << " ms";
+}
+
+
 /** provide the user with some information about the ports */
 void
 jpop_options::print_usage()
 {
         std::cout << "Usage: " << _program_name << " [options]\n"
-                  << visible_opts << std::endl
-                  << "Ports:\n"
-                  << " * in:        input port\n"
-                  << " * out:       output port\n"
-                  << std::endl;
+                  << visible_opts << std::endl;
+        print_ports("input port", "output port");
 }
-
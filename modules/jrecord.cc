@@ -14,6 +14,7 @@
 #include <signal.h>
 #include <boost/shared_ptr.hpp>
 #include <string>
+#include <boost/algorithm/string.hpp>
 
 #include "jill/logging.hh"
 #include "jill/jack_client.hh"
@@ -41,13 +42,27 @@ public:
         /** key-value pairs to store as attributes in created entries */
         std::map<string, string> additional_options;
 
+        /** trigger groups: name -> comma-separated list of recorded channels */
+        std::map<string, string> trigger_groups;
+        /** trigger groups: name -> source port for the group's trigger port */
+        std::map<string, string> trigger_group_inputs;
+
         string output_file;
 	float pretrigger_size_s;
 	float posttrigger_size_s;
+        float merge_window_s;
 	float buffer_size_s;
 	int max_size_mb;
+        float max_duration_s;
+        int max_entries;
         int compression;
 
+        /** storage format for sampled data, and exceptions by channel */
+        file::arf_writer::sample_format_t sample_format;
+        std::map<string, file::arf_writer::sample_format_t> channel_formats;
+        std::size_t encoder_threads;
+        std::size_t overview_levels;
+
 protected:
 
 	virtual void print_usage();
@@ -59,33 +74,28 @@ jrecord_options options(PROGRAM_NAME);
 boost::shared_ptr<jack_client> client;
 boost::shared_ptr<dsp::buffered_data_writer> arf_thread;
 jack_port_t * port_trig = 0;
+bool triggered = false;
 
 
 int
 process(jack_client *client, nframes_t nframes, nframes_t time)
 {
-        jack_port_t *port;
-        void *buffer;
-        jack_client::port_list_type::const_iterator it;
+        jack_client::port_table_type::const_iterator it;
 
-        for (it = client->ports().begin(); it != client->ports().end(); ++it) {
-                port = *it;
-                buffer = jack_port_get_buffer(port, nframes);
+        for (it = client->audio_ports().begin(); it != client->audio_ports().end(); ++it) {
+                void * buffer = jack_port_get_buffer(it->port, nframes);
                 if (buffer == 0) continue;
-                if (strcmp(jack_port_type(port), JACK_DEFAULT_AUDIO_TYPE) == 0) {
-                        arf_thread->push(time, SAMPLED, jack_port_short_name(port),
-                                         nframes * sizeof(sample_t), buffer);
-                }
-                else {
-                        jack_midi_event_t event;
-                        nframes_t nevents = jack_midi_get_event_count(buffer);
-                        for (nframes_t j = 0; j < nevents; ++j) {
-                                jack_midi_event_get(&event, buffer, j);
-                                if (event.size == 0) continue;
-                                arf_thread->push(time + event.time,
-                                                 EVENT, jack_port_short_name(port),
-                                                 event.size, event.buffer);
-                        }
+                arf_thread->push(time, SAMPLED, it->name.c_str(),
+                                 nframes * sizeof(sample_t), buffer);
+        }
+        for (it = client->midi_ports().begin(); it != client->midi_ports().end(); ++it) {
+                midi_event_cache const * events = client->midi_events(*it, nframes);
+                if (events == 0) continue;
+                midi_event_cache::const_iterator event;
+                for (event = events->begin(); event != events->end(); ++event) {
+                        if (event->size == 0) continue;
+                        arf_thread->push(time + event->time, EVENT, it->name.c_str(),
+                                         event->size, event->buffer);
                 }
         }
         arf_thread->data_ready();
@@ -107,7 +117,7 @@ int
 jack_bufsize(jack_client *client, nframes_t nframes)
 {
         std::size_t bytes = client->sampling_rate() * options.buffer_size_s * client->nports();
-        if (port_trig != 0)
+        if (triggered)
                 bytes += client->sampling_rate() * options.pretrigger_size_s * client->nports();
         // will block until buffer is empty (with any current implementation, anyway)
         bytes = arf_thread->request_buffer_size(bytes * sizeof(sample_t));
@@ -170,21 +180,60 @@ main(int argc, char **argv)
 	try {
 		options.parse(argc,argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
-                writer.reset(new file::arf_writer(options.output_file,
-                                                  *client,
-                                                  options.additional_options,
-                                                  options.compression));
+                file::arf_writer * arf = new file::arf_writer(options.output_file,
+                                                             *client,
+                                                             options.additional_options,
+                                                             options.compression);
+                writer.reset(arf);
+                arf->set_sample_format(options.sample_format);
+                for (map<string, file::arf_writer::sample_format_t>::const_iterator it =
+                             options.channel_formats.begin();
+                     it != options.channel_formats.end(); ++it) {
+                        arf->set_sample_format(it->first, it->second);
+                }
+                arf->set_dither(options.count("dither"));
+                arf->set_encoder_threads(options.encoder_threads);
+                arf->set_overview(options.overview_levels);
+                arf->set_rollover(boost::uint64_t(options.max_size_mb) << 20,
+                                  options.max_duration_s, options.max_entries);
+                if (options.count("hex-events")) {
+                        LOG << "storing events in hex-encoded (compatibility) format";
+                        arf->set_event_format(file::arf_writer::EVENT_HEX);
+                }
 
-                /* create ports: one for trigger, and one for each input */
-                if (options.count("trig")) {
+                /* create ports: one for each trigger, and one for each input */
+                if (options.count("trig") || !options.trigger_groups.empty()) {
                         LOG << "recordings will be triggered";
-                        port_trig = client->register_port("trig_in",JACK_DEFAULT_MIDI_TYPE,
-                                                          JackPortIsInput | JackPortIsTerminal, 0);
-                        arf_thread.reset(new dsp::triggered_data_writer(
-                                                 writer,
-                                                 jack_port_short_name(port_trig),
-                                                 options.pretrigger_size_s * client->sampling_rate(),
-                                                 options.posttrigger_size_s * client->sampling_rate()));
+                        triggered = true;
+                        dsp::triggered_data_writer * trig_thread =
+                                new dsp::triggered_data_writer(
+                                        writer,
+                                        options.pretrigger_size_s * client->sampling_rate(),
+                                        options.posttrigger_size_s * client->sampling_rate());
+                        arf_thread.reset(trig_thread);
+                        trig_thread->set_merge_window(options.merge_window_s * client->sampling_rate());
+                        if (options.count("trig")) {
+                                port_trig = client->register_port("trig_in",JACK_DEFAULT_MIDI_TYPE,
+                                                                  JackPortIsInput | JackPortIsTerminal, 0);
+                                trig_thread->add_group(jack_port_short_name(port_trig), writer);
+                        }
+                        /* each group gets its own trigger port and writer */
+                        for (map<string,string>::const_iterator it = options.trigger_groups.begin();
+                             it != options.trigger_groups.end(); ++it) {
+                                string port_name = "trig_" + it->first;
+                                svec channels;
+                                boost::split(channels, it->second, boost::is_any_of(","),
+                                             boost::token_compress_on);
+                                map<string,string> attrs;
+                                attrs["jill_trigger_group"] = it->first;
+                                boost::shared_ptr<data_writer> group_writer(
+                                        new file::arf_writer(*arf, attrs));
+                                client->register_port(port_name, JACK_DEFAULT_MIDI_TYPE,
+                                                      JackPortIsInput | JackPortIsTerminal, 0);
+                                trig_thread->add_group(port_name, group_writer, channels);
+                                LOG << "trigger group " << it->first << ": " << port_name
+                                    << " -> " << it->second;
+                        }
                 }
                 else {
                         LOG << "recording will be continuous";
@@ -257,6 +306,10 @@ main(int argc, char **argv)
                         svec const & plist = options.vmap["trig"].as<svec>();
                         client->connect_ports(plist.begin(), plist.end(), "trig_in");
                 }
+                for (map<string,string>::const_iterator it = options.trigger_group_inputs.begin();
+                     it != options.trigger_group_inputs.end(); ++it) {
+                        client->connect_port(it->second, "trig_" + it->first);
+                }
                 for (map<string,string>::const_iterator it = port_connections.begin();
                      it != port_connections.end(); ++it) {
                         if (!it->second.empty()) client->connect_port(it->second, it->first);
@@ -297,6 +350,10 @@ jrecord_options::jrecord_options(string const &program_name)
                 ("in-evt,E",  po::value<svec>(), "create an input port for event data")
                 ("trig,t",    po::value<svec>()->multitoken()->zero_tokens(),
                  "record in triggered mode (optionally specify inputs)")
+                ("trig-group", po::value<svec>(),
+                 "add a trigger group that records a subset of channels (name=chan1,chan2,...)")
+                ("trig-group-in", po::value<svec>(),
+                 "connect a trigger group's trigger port (name=port)")
                 ("buffer",     po::value<float>(&buffer_size_s)->default_value(2.0),
                  "minimum ringbuffer size (s)");
 
@@ -308,8 +365,26 @@ jrecord_options::jrecord_options(string const &program_name)
                  "duration to record before onset trigger (s)")
                 ("posttrigger", po::value<float>(&posttrigger_size_s)->default_value(0.5),
                  "duration to record after offset trigger (s)")
+                ("merge", po::value<float>(&merge_window_s)->default_value(0.0),
+                 "onsets this soon after an offset extend the current entry (s)")
                 ("compression", po::value<int>(&compression)->default_value(0),
-                 "set compression in output file (0-9)");
+                 "set compression in output file (0-9)")
+                ("hex-events", "store event messages as hex-encoded strings (compatibility)")
+                ("sample-format", po::value<string>()->default_value("float"),
+                 "storage format for sampled data (float, int16, int24, lossless16, or lossless24)")
+                ("channel-format", po::value<svec>(),
+                 "storage format for a specific channel (channel=format)")
+                ("dither", "dither samples stored as integers")
+                ("encoder-threads", po::value<std::size_t>(&encoder_threads)->default_value(2),
+                 "number of threads for lossless compression")
+                ("overview", po::value<std::size_t>(&overview_levels)->default_value(0),
+                 "store min/max/RMS overviews of sampled data with this many levels")
+                ("max-size", po::value<int>(&max_size_mb)->default_value(0),
+                 "start a new file when the current one reaches this size (MB)")
+                ("max-duration", po::value<float>(&max_duration_s)->default_value(0),
+                 "start a new file when the current one has been open this long (s)")
+                ("max-entries", po::value<int>(&max_entries)->default_value(0),
+                 "start a new file when the current one has this many entries");
 
         // command-line options
         cmd_opts.add(jillopts).add(tropts);
@@ -328,11 +403,26 @@ jrecord_options::print_usage()
                   << "Ports (all are recorded):\n"
                   << " * pcm_NNN:    sampled input ports\n"
                   << " * evt_NNN:    event input ports\n"
-                  << " * trig_in:    MIDI port to receive events triggering recording"
+                  << " * trig_in:    MIDI port to receive events triggering recording\n"
+                  << " * trig_NAME:  MIDI port to receive events triggering group NAME"
                   << std::endl;
 }
 
 
+/** parse the name of a sample storage format */
+static file::arf_writer::sample_format_t
+parse_sample_format(string const & name)
+{
+        if (name == "float") return file::arf_writer::SAMPLE_FLOAT;
+        else if (name == "int16") return file::arf_writer::SAMPLE_INT16;
+        else if (name == "int24") return file::arf_writer::SAMPLE_INT24;
+        else if (name == "lossless16") return file::arf_writer::SAMPLE_LOSSLESS16;
+        else if (name == "lossless24") return file::arf_writer::SAMPLE_LOSSLESS24;
+        LOG << "ERROR: unknown sample format " << name;
+        throw Exit(EXIT_FAILURE);
+}
+
+
 void
 jrecord_options::process_options()
 {
@@ -343,6 +433,21 @@ jrecord_options::process_options()
         }
         
         parse_keyvals(additional_options, "attr");
+        sample_format = parse_sample_format(vmap["sample-format"].as<string>());
+        std::map<string,string> formats;
+        parse_keyvals(formats, "channel-format");
+        for (std::map<string,string>::const_iterator it = formats.begin(); it != formats.end(); ++it) {
+                channel_formats[it->first] = parse_sample_format(it->second);
+        }
+        parse_keyvals(trigger_groups, "trig-group");
+        parse_keyvals(trigger_group_inputs, "trig-group-in");
+        for (std::map<string,string>::const_iterator it = trigger_group_inputs.begin();
+             it != trigger_group_inputs.end(); ++it) {
+                if (trigger_groups.find(it->first) == trigger_groups.end()) {
+                        LOG << "ERROR: no such trigger group: " << it->first;
+                        throw Exit(EXIT_FAILURE);
+                }
+        }
         
         // required additional attributes which will be asked for if
         // not given initially
@@ -66,7 +66,9 @@ boost::shared_ptr<jack_client> client;
 boost::shared_ptr<util::readahead_stimqueue> queue;
 boost::ptr_vector<stimulus_t> _stimuli;
 std::vector<stimulus_t *> _stimlist;
-jack_port_t *port_out, *port_trigout, *port_trigin, *port_pulse;
+std::vector<jack_port_t *> ports_out;
+std::vector<sample_t *> buffers_out;  // preallocated to avoid allocation in process()
+jack_port_t *port_trigout, *port_trigin, *port_pulse;
 
 static const nframes_t PulseLen = 10;
 
@@ -91,6 +93,11 @@ static int xruns = 0;                  // xrun counter
  * available) into the output buffer, starting with the onset time. Advance the
  * stimulus buffer tracking variable to reflect the number of samples played.
  *
+ * Multichannel stimuli are played through one output port per channel. All the
+ * channels are copied in the same cycle, so their onsets are sample-aligned. If
+ * the stimulus has fewer channels than there are ports, the extra ports are
+ * silent.
+ *
  */
 int
 process(jack_client *client, nframes_t nframes, nframes_t time)
@@ -103,9 +110,12 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         nframes_t period_offset;      // the offset in the period to start copying
 
         void * trig = client->events(port_trigout, nframes);
-        sample_t * out = client->samples(port_out, nframes);
-        // zero the output buffer - somewhat inefficient but safer
-        memset(out, 0, nframes * sizeof(sample_t));
+        std::size_t const nports = ports_out.size();
+        for (std::size_t c = 0; c < nports; ++c) {
+                buffers_out[c] = client->samples(ports_out[c], nframes);
+                // zero the output buffer - somewhat inefficient but safer
+                memset(buffers_out[c], 0, nframes * sizeof(sample_t));
+        }
         
         sample_t* pulse_buf = client->samples(port_pulse, nframes);                
         if (pulse_buf) memset(pulse_buf, 0, nframes * sizeof(sample_t));
@@ -135,8 +145,7 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         }
         // is there an external trigger?
         else if (port_trigin) {
-                void * midi_buffer = client->events(port_trigin, nframes);
-                period_offset = midi::find_trigger(midi_buffer, true);
+                period_offset = client->midi_events(port_trigin, nframes)->find_trigger(true);
                 if (period_offset > nframes) return 0; // no trigger
                 last_start = time + period_offset;
                 midi::write_message(trig, period_offset, midi::stim_on, stim->name());
@@ -197,9 +206,12 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         
                                              
         if (nsamples > 0) {
-                memcpy(out + period_offset,
-                       stim->buffer() + stim_offset,
-                       nsamples * sizeof(sample_t));
+                std::size_t nchans = std::min(stim->nchannels(), nports);
+                for (std::size_t c = 0; c < nchans; ++c) {
+                        memcpy(buffers_out[c] + period_offset,
+                               stim->buffer(c) + stim_offset,
+                               nsamples * sizeof(sample_t));
+                }
                 stim_offset += nsamples;
         }
         // did the stimulus end?
@@ -246,13 +258,17 @@ signal_handler(int sig)
 }
 
 
-/* parse the list of stimuli */
-static void
+/*
+ * parse the list of stimuli. Returns the largest number of channels in any of
+ * the stimuli
+ */
+static size_t
 init_stimset(std::vector<string> const & stims, size_t const default_nreps)
 {
         using namespace boost::filesystem;
 
         size_t nreps;
+        size_t nchannels = 1;
         for (size_t i = 0; i < stims.size(); ++i) {
                 path p(stims[i]);
                 if ((i+1) < stims.size()) {
@@ -264,6 +280,7 @@ init_stimset(std::vector<string> const & stims, size_t const default_nreps)
                 try {
                         jill::stimulus_t *stim = new file::stimfile(p.string());
                         _stimuli.push_back(stim);
+                        nchannels = std::max(nchannels, stim->nchannels());
                         for (size_t j = 0; j < nreps; ++j)
                                 _stimlist.push_back(stim);
                 }
@@ -271,6 +288,7 @@ init_stimset(std::vector<string> const & stims, size_t const default_nreps)
                         LOG << "invalid stimulus " << p << ": " << e.what();
                 }
         }
+        return nchannels;
 }
 
 
@@ -297,7 +315,7 @@ main(int argc, char **argv)
 		}
 
                 /* stimulus queue */
-                init_stimset(options.stimuli, options.nreps);
+                size_t nchannels = init_stimset(options.stimuli, options.nreps);
                 if (options.count("shuffle")) {
                         LOG << "shuffled stimuli";
                         random_shuffle(_stimlist.begin(), _stimlist.end());
@@ -306,8 +324,21 @@ main(int argc, char **argv)
                                                           client->sampling_rate(),
                                                           options.count("loop")));
 
-                port_out = client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
-                                                 JackPortIsOutput | JackPortIsTerminal, 0);
+                /* one output port per channel; single-channel sets keep the old name */
+                if (nchannels == 1) {
+                        ports_out.push_back(client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
+                                                                  JackPortIsOutput | JackPortIsTerminal, 0));
+                }
+                else {
+                        LOG << "multichannel stimuli: " << nchannels << " output ports";
+                        for (size_t c = 0; c < nchannels; ++c) {
+                                char buf[16];
+                                sprintf(buf, "out_%03zu", c);
+                                ports_out.push_back(client->register_port(buf, JACK_DEFAULT_AUDIO_TYPE,
+                                                                          JackPortIsOutput | JackPortIsTerminal, 0));
+                        }
+                }
+                buffers_out.resize(ports_out.size(), 0);
                 port_trigout = client->register_port("trig_out",JACK_DEFAULT_MIDI_TYPE,
                                                      JackPortIsOutput | JackPortIsTerminal, 0);
                 if (options.count("trig")) {
@@ -335,7 +366,16 @@ main(int argc, char **argv)
                 // when the buffer size *changes*
                 client->set_buffer_size_callback(jack_bufsize);
 
-                client->connect_ports("out", options.output_ports.begin(), options.output_ports.end());
+                if (ports_out.size() == 1) {
+                        client->connect_ports("out", options.output_ports.begin(), options.output_ports.end());
+                }
+                else {
+                        // connections are assigned to channels in order
+                        for (size_t i = 0; i < options.output_ports.size(); ++i) {
+                                jack_port_t * port = ports_out[i % ports_out.size()];
+                                client->connect_port(jack_port_short_name(port), options.output_ports[i]);
+                        }
+                }
                 client->connect_ports("trig_out", options.trigout_ports.begin(), options.trigout_ports.end());
                 client->connect_ports(options.trigin_ports.begin(), options.trigin_ports.end(), "trig_in");
                 client->connect_ports("pulse_out", options.pulse_ports.begin(), options.pulse_ports.end());
@@ -371,7 +411,7 @@ jstim_options::jstim_options(string const &program_name)
                 ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
                  "set client name")
                 ("out,o",     po::value<vector<string> >(&output_ports),
-                 "add connection to output audio port")
+                 "add connection to output audio port (multichannel: assigned to channels in order)")
                 ("event,e",   po::value<vector<string> >(&trigout_ports),
                  "add connection to output event port")
                 ("chan,c",    po::value<midi::data_type>(&trigout_chan)->default_value(0),
@@ -406,6 +446,7 @@ jstim_options::print_usage()
                   << visible_opts << std::endl
                   << "Ports:\n"
                   << " * out:       sampled output of the presented stimulus\n"
+                  << " * out_NNN:   (multichannel stimuli) one sampled output per channel\n"
                   << " * trig_out:  event port reporting stimulus onset/offsets\n"
                   << " * trig_in:   (optional) event port for triggering playback"
                   << std::endl;
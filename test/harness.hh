@@ -0,0 +1,117 @@
+/* -*- mode: c++ -*-
+ *
+ * Helpers shared by the disk thread harnesses (test_arf_thread,
+ * test_xrun_replay) and the file benchmarks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
+#ifndef _TEST_HARNESS_HH
+#define _TEST_HARNESS_HH
+
+#include <string>
+#include <unistd.h>
+#include <boost/shared_ptr.hpp>
+
+#include "jill/types.hh"
+#include "jill/data_source.hh"
+#include "jill/data_writer.hh"
+
+namespace jill { namespace test {
+
+/** A data source with a fixed sampling rate and no clock */
+class fixed_source : public data_source {
+public:
+        fixed_source(char const * name, nframes_t sampling_rate)
+                : _name(name), _sampling_rate(sampling_rate) {}
+        char const * name() const { return _name; }
+        nframes_t sampling_rate() const { return _sampling_rate; }
+        nframes_t frame() const { return 0; }
+        nframes_t frame(utime_t t) const { return t * _sampling_rate / 1000000; }
+        utime_t time(nframes_t t) const { return utime_t(t) * 1000000 / _sampling_rate; }
+        utime_t time() const { return 0; }
+private:
+        char const * _name;
+        nframes_t _sampling_rate;
+};
+
+/**
+ * Passes everything to another writer. Derived classes override the calls
+ * they want to observe and chain to these.
+ */
+class passthrough_writer : public data_writer {
+public:
+        passthrough_writer(boost::shared_ptr<data_writer> w) : _w(w) {}
+        bool ready() const { return _w->ready(); }
+        void new_entry(nframes_t frame) { _w->new_entry(frame); }
+        void close_entry() { _w->close_entry(); }
+        void xrun() { _w->xrun(); }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) {
+                _w->write(data, start, stop);
+        }
+        void log(timestamp_t const & time, std::string const & source,
+                 std::string const & message) {
+                _w->log(time, source, message);
+        }
+        void flush() { _w->flush(); }
+
+        /** the wrapped writer; reset to close it */
+        boost::shared_ptr<data_writer> _w;
+};
+
+/**
+ * Instruments a buffered_data_writer (or a class derived from it). Counts the
+ * blocks accepted and rejected by push() and the blocks consumed by the disk
+ * thread, and tracks the maximum fill of the ringbuffer.
+ */
+template <typename Base>
+class monitored : public Base {
+public:
+        template <typename A1, typename A2>
+        monitored(A1 const & a1, A2 const & a2)
+                : Base(a1, a2), accepted(0), dropped(0), consumed(0), max_fill(0) {}
+
+        template <typename A1, typename A2, typename A3, typename A4>
+        monitored(A1 const & a1, A2 const & a2, A3 const & a3, A4 const & a4)
+                : Base(a1, a2, a3, a4), accepted(0), dropped(0), consumed(0), max_fill(0) {}
+
+        void push(nframes_t time, dtype_t dtype, char const * id, size_t size, void const * data) {
+                size_t pos = this->_buffer->write_position();
+                Base::push(time, dtype, id, size, data);
+                if (this->_buffer->write_position() == pos) ++dropped;
+                else ++accepted;
+        }
+
+        /** call after each period to update max_fill */
+        void sample_fill() {
+                double fill = double(this->_buffer->read_space()) / this->_buffer->size();
+                if (fill > max_fill) max_fill = fill;
+        }
+
+        /** wait until the disk thread has consumed every accepted block */
+        void await() {
+                while (__sync_add_and_fetch(&consumed, 0) < accepted) {
+                        this->data_ready();
+                        usleep(100);
+                }
+        }
+
+        unsigned long accepted;
+        unsigned long dropped;
+        unsigned long consumed;
+        double max_fill;
+
+protected:
+        void write(data_block_t const * data) {
+                Base::write(data);
+                __sync_add_and_fetch(&consumed, 1);
+        }
+};
+
+}} // namespace jill::test
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Stress test for the disk thread. Feeds N channels of synthetic periods at a
+ * fixed rate into buffered_data_writer or triggered_data_writer, backed by
+ * null_writer or arf_writer, and reports the sustained throughput, the maximum
+ * fill of the ringbuffer, and the number of blocks that were dropped because
+ * the ringbuffer was full. Runs once for each channel count in a list,
+ * stopping after the first count that drops data (the overrun knee).
+ *
+ * Usage: test_arf_thread [-c 1,2,4,...] [-p period] [-r rate] [-s seconds]
+ *                        [-b buffer_seconds] [-x speed] [-t] [-g gate_seconds]
+ *                        [-a] [-z compression] [-o file.arf] [-k]
+ *
+ *  -c  channel counts to test (default 1,2,4,...,256)
+ *  -p  period size, in frames (default 1024)
+ *  -r  sampling rate (default 48000)
+ *  -s  duration of each run, in seconds of data (default 5)
+ *  -b  size of the ringbuffer, in seconds (default 2)
+ *  -x  speed relative to realtime; 0 to push as fast as possible (default 1)
+ *  -t  use triggered_data_writer. The trigger channel is always on unless -g
+ *  -g  toggle the trigger every N seconds
+ *  -a  write to an ARF file instead of null_writer
+ *  -z  compression level for ARF datasets (default 0)
+ *  -o  the ARF file (default test_arf_thread.arf); removed after each run
+ *  -k  keep the ARF files, with the channel count appended to the name
+ *
+ * In triggered mode, blocks in overlapping pre- and posttrigger windows are
+ * written to both entries, so more blocks may be written than pushed.
+ */
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/filesystem.hpp>
+
+#include "jill/midi.hh"
+#include "jill/file/null_writer.hh"
+#include "jill/file/arf_writer.hh"
+#include "jill/dsp/block_ringbuffer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+#include "jill/dsp/triggered_data_writer.hh"
+#include "test/harness.hh"
+
+using namespace std;
+using namespace jill;
+
+nframes_t period_size = 1024;
+nframes_t sampling_rate = 48000;
+double nseconds = 5;
+double buffer_seconds = 2;
+double speed = 1;
+bool triggered = false;
+double gate_seconds = 0;
+bool use_arf = false;
+int compression = 0;
+string arf_path = "test_arf_thread.arf";
+bool keep_files = false;
+
+char const * trigger_id = "trig";
+
+/* passes data to another writer, counting what goes through */
+class counting_writer : public test::passthrough_writer {
+public:
+        counting_writer(boost::shared_ptr<data_writer> w)
+                : passthrough_writer(w), blocks(0), bytes(0), xruns(0) {}
+        void xrun() {
+                __sync_add_and_fetch(&xruns, 1);
+                passthrough_writer::xrun();
+        }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) {
+                passthrough_writer::write(data, start, stop);
+                __sync_add_and_fetch(&blocks, 1);
+                __sync_add_and_fetch(&bytes, data->sz_data);
+        }
+
+        unsigned long blocks;
+        unsigned long long bytes;
+        unsigned long xruns;
+};
+
+struct result {
+        size_t nchannels;
+        unsigned long pushed;
+        unsigned long dropped;
+        unsigned long written;
+        unsigned long xruns;
+        double max_fill;
+        double elapsed;                 // seconds spent pushing data
+        double mbps;                    // written during the run, in MB/s
+};
+
+double
+seconds_since(timespec const & t0)
+{
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (t.tv_sec - t0.tv_sec) + (t.tv_nsec - t0.tv_nsec) * 1e-9;
+}
+
+/* push periods like a process callback, sleeping between them if speed > 0 */
+template <typename Thread>
+result
+run(size_t nchannels, boost::shared_ptr<Thread> thread, counting_writer & counter)
+{
+        result r = { nchannels, 0, 0, 0, 0, 0, 0, 0 };
+        vector<sample_t> data(period_size);
+        unsigned short seed[3] = { 0 };
+        for (size_t i = 0; i < period_size; ++i) data[i] = erand48(seed) - 0.5;
+        vector<string> ids(nchannels);
+        char buf[32];
+        for (size_t c = 0; c < nchannels; ++c) {
+                snprintf(buf, sizeof(buf), "pcm_%03zu", c);
+                ids[c] = buf;
+        }
+        midi::data_type onset[] = { midi::note_on, 0, 64 };
+        midi::data_type offset[] = { midi::note_off, 0, 0 };
+        nframes_t const gate_frames = gate_seconds * sampling_rate;
+        size_t const nperiods = nseconds * sampling_rate / period_size;
+        long const period_ns = (speed > 0) ? 1e9 * period_size / sampling_rate / speed : 0;
+
+        thread->start();
+        usleep(10000);          // let the thread start before any stop()
+
+        timespec t0, next;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        next = t0;
+        bool gate = false;
+        for (size_t p = 0; p < nperiods; ++p) {
+                nframes_t time = p * period_size;
+                if (triggered) {
+                        bool on = (gate_frames == 0) || ((time / gate_frames) % 2 == 0);
+                        if (on != gate || p == 0) {
+                                thread->push(time, EVENT, trigger_id, 3, on ? onset : offset);
+                                gate = on;
+                        }
+                }
+                for (size_t c = 0; c < nchannels; ++c)
+                        thread->push(time, SAMPLED, ids[c].c_str(),
+                                     period_size * sizeof(sample_t), &data[0]);
+                thread->data_ready();
+                thread->sample_fill();
+                r.pushed += nchannels;
+                if (period_ns > 0) {
+                        next.tv_nsec += period_ns;
+                        while (next.tv_nsec >= 1000000000) {
+                                next.tv_nsec -= 1000000000;
+                                next.tv_sec += 1;
+                        }
+                        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0);
+                }
+        }
+        r.elapsed = seconds_since(t0);
+        r.mbps = __sync_add_and_fetch(&counter.bytes, 0) / r.elapsed / (1 << 20);
+
+        thread->stop();
+        thread->join();
+        r.dropped = thread->dropped;
+        r.max_fill = thread->max_fill;
+        r.written = counter.blocks;
+        r.xruns = counter.xruns;
+        return r;
+}
+
+result
+run(size_t nchannels)
+{
+        boost::shared_ptr<data_writer> sink;
+        string path = arf_path;
+        test::fixed_source source("test_arf_thread", sampling_rate);
+        if (use_arf) {
+                if (keep_files) {
+                        char buf[32];
+                        snprintf(buf, sizeof(buf), "_%zu", nchannels);
+                        boost::filesystem::path p(arf_path);
+                        path = (p.parent_path() / (p.stem().string() + buf + p.extension().string()))
+                                .string();
+                }
+                std::map<string, string> attrs;
+                sink.reset(new file::arf_writer(path, source, attrs, compression));
+        }
+        else {
+                sink.reset(new file::null_writer(false));
+        }
+        boost::shared_ptr<counting_writer> counter(new counting_writer(sink));
+
+        // the buffer holds blocks with headers for all the channels
+        size_t block_bytes = sizeof(data_block_t) + 8 + period_size * sizeof(sample_t);
+        size_t buffer_bytes = buffer_seconds * sampling_rate / period_size * nchannels * block_bytes;
+
+        result r;
+        if (triggered) {
+                typedef test::monitored<dsp::triggered_data_writer> thread_type;
+                boost::shared_ptr<thread_type> thread(
+                        new thread_type(counter, string(trigger_id), sampling_rate / 2,
+                                        sampling_rate / 2));
+                thread->request_buffer_size(buffer_bytes);
+                r = run(nchannels, thread, *counter);
+        }
+        else {
+                typedef test::monitored<dsp::buffered_data_writer> thread_type;
+                boost::shared_ptr<thread_type> thread(new thread_type(counter, buffer_bytes));
+                r = run(nchannels, thread, *counter);
+        }
+        sink.reset();
+        counter.reset();
+        if (use_arf && !keep_files) boost::filesystem::remove(path);
+        return r;
+}
+
+vector<size_t>
+parse_list(char const * arg)
+{
+        vector<size_t> out;
+        char * end;
+        while (*arg) {
+                long n = strtol(arg, &end, 10);
+                if (end == arg || n <= 0) {
+                        fprintf(stderr, "invalid channel list\n");
+                        exit(EXIT_FAILURE);
+                }
+                out.push_back(n);
+                arg = (*end == ',') ? end + 1 : end;
+        }
+        return out;
+}
+
+int
+main(int argc, char **argv)
+{
+        vector<size_t> channels;
+        int c;
+        while ((c = getopt(argc, argv, "c:p:r:s:b:x:tg:az:o:k")) != -1) {
+                switch (c) {
+                case 'c': channels = parse_list(optarg); break;
+                case 'p': period_size = atoi(optarg); break;
+                case 'r': sampling_rate = atoi(optarg); break;
+                case 's': nseconds = atof(optarg); break;
+                case 'b': buffer_seconds = atof(optarg); break;
+                case 'x': speed = atof(optarg); break;
+                case 't': triggered = true; break;
+                case 'g': gate_seconds = atof(optarg); break;
+                case 'a': use_arf = true; break;
+                case 'z': compression = atoi(optarg); break;
+                case 'o': arf_path = optarg; break;
+                case 'k': keep_files = true; break;
+                default:
+                        fprintf(stderr, "see the comment at the top of %s.cc for usage\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (channels.empty())
+                for (size_t n = 1; n <= 256; n *= 2) channels.push_back(n);
+
+        printf("# %s, %s, period=%u, rate=%u, buffer=%.2f s, speed=%.2f\n",
+               triggered ? "triggered_data_writer" : "buffered_data_writer",
+               use_arf ? "arf_writer" : "null_writer", period_size, sampling_rate,
+               buffer_seconds, speed);
+        printf("channels\tpushed\tdropped\twritten\txruns\tmax_fill\tMB/s\n");
+        size_t knee = 0;
+        for (vector<size_t>::const_iterator n = channels.begin(); n != channels.end(); ++n) {
+                result r = run(*n);
+                printf("%zu\t%lu\t%lu\t%lu\t%lu\t%.3f\t%.2f\n", r.nchannels, r.pushed, r.dropped,
+                       r.written, r.xruns, r.max_fill, r.mbps);
+                fflush(stdout);
+                if (r.dropped > 0) {
+                        knee = *n;
+                        break;
+                }
+        }
+        if (knee)
+                printf("# overrun at %zu channels\n", knee);
+        else
+                printf("# no overruns\n");
+        return EXIT_SUCCESS;
+}
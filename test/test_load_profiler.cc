@@ -0,0 +1,69 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <pthread.h>
+
+#include "jill/load_profiler.hh"
+
+using namespace std;
+using namespace jill;
+
+const double width = 1.0 / load_profiler::nbins;
+
+/* uniform loads between 0 and 1 */
+void test_uniform()
+{
+        load_profiler p;
+        for (int i = 0; i < 1000; ++i) p.record((i + 0.5) / 1000);
+        load_profiler::stats s = p.get();
+        assert(s.count == 1000);
+        assert(fabs(s.p50 - 0.5) <= width);
+        assert(fabs(s.p99 - 0.99) <= width);
+        assert(fabs(s.max - 0.9995) < 1e-6);
+        p.reset();
+        s = p.get();
+        assert(s.count == 0 && s.max == 0 && s.p50 == 0);
+}
+
+/* overloaded cycles are counted above 100% and reported by max */
+void test_overload()
+{
+        load_profiler p;
+        for (int i = 0; i < 98; ++i) p.record(0.1);
+        p.record(1.5);
+        p.record(2.5);
+        load_profiler::stats s = p.get();
+        assert(fabs(s.p50 - 0.1) <= width);
+        assert(fabs(s.p99 - 2.5) < 1e-6);
+        assert(fabs(s.max - 2.5) < 1e-6);
+
+        timespec t0 = { 1, 900000000 }, t1 = { 2, 100000000 };
+        p.reset();
+        p.record(t0, t1, 1e9);          // 200 ms in a 1 s period
+        assert(fabs(p.get().max - 0.2) < 1e-6);
+}
+
+void * recorder(void * arg)
+{
+        load_profiler * p = static_cast<load_profiler*>(arg);
+        for (int i = 0; i < 100000; ++i) p->record(0.25);
+        return 0;
+}
+
+/* concurrent recording doesn't lose counts */
+void test_threads()
+{
+        load_profiler p;
+        pthread_t threads[4];
+        for (int i = 0; i < 4; ++i) pthread_create(threads + i, 0, recorder, &p);
+        for (int i = 0; i < 4; ++i) pthread_join(threads[i], 0);
+        assert(p.get().count == 400000);
+}
+
+int main(int, char**)
+{
+        test_uniform();
+        test_overload();
+        test_threads();
+        cout << "load profiler tests passed" << endl;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+
+#include "jill/dsp/overview.hh"
+
+using namespace std;
+using namespace jill;
+
+const size_t base = 16;
+const size_t factor = 4;
+
+/* push a ramp in blocks of period samples and check the summaries */
+void test_pyramid(size_t period, size_t nsamples)
+{
+        dsp::overview_pyramid p(base, factor, 3);
+        assert(p.nlevels() == 3);
+        assert(p.bin_size(0) == base);
+        assert(p.bin_size(2) == base * factor * factor);
+
+        vector<sample_t> x(nsamples);
+        for (size_t i = 0; i < nsamples; ++i) x[i] = (i % 2) ? -float(i) : float(i);
+        for (size_t i = 0; i < nsamples; i += period) {
+                p.push(&x[i], min(period, nsamples - i));
+        }
+        p.finish();
+
+        for (size_t level = 0; level < p.nlevels(); ++level) {
+                size_t size = p.bin_size(level);
+                vector<dsp::overview_record> const & r = p.records(level);
+                assert(r.size() == (nsamples + size - 1) / size);
+                for (size_t j = 0; j < r.size(); ++j) {
+                        size_t start = j * size;
+                        size_t stop = min(start + size, nsamples);
+                        float lo = x[start], hi = x[start];
+                        double sumsq = 0;
+                        for (size_t i = start; i < stop; ++i) {
+                                lo = min(lo, x[i]);
+                                hi = max(hi, x[i]);
+                                sumsq += x[i] * x[i];
+                        }
+                        assert(r[j].min == lo);
+                        assert(r[j].max == hi);
+                        assert(fabs(r[j].rms - sqrt(sumsq / (stop - start))) < 1e-3 * r[j].rms);
+                }
+        }
+}
+
+int main(int, char**)
+{
+        test_pyramid(64, 1024);
+        test_pyramid(7, 1000);
+        test_pyramid(1000, 5000);
+        cout << "overview tests passed" << endl;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+#include "jill/dsp/rice_codec.hh"
+#include "jill/dsp/chunk_encoder.hh"
+
+using namespace std;
+using namespace jill;
+using boost::int32_t;
+
+/* encode and decode a signal, returning the compression ratio */
+double
+roundtrip(vector<int32_t> const & x)
+{
+        vector<char> buf;
+        size_t nbytes = dsp::rice_codec::encode(&x[0], x.size(), buf);
+        assert(nbytes == buf.size());
+
+        vector<int32_t> y;
+        size_t n = dsp::rice_codec::decode(&buf[0], buf.size(), y);
+        assert(n == x.size());
+        assert(y == x);
+        return double(x.size() * sizeof(int32_t)) / nbytes;
+}
+
+/* chunks come out of the encoder in the order they went in */
+void
+test_encoder(size_t nthreads, size_t nchunks)
+{
+        dsp::chunk_encoder enc(nthreads);
+        assert(enc.nthreads() == nthreads);
+        size_t collected = 0;
+        for (size_t i = 0; i < nchunks; ++i) {
+                dsp::chunk_encoder::chunk * c = enc.acquire();
+                c->samples.resize(1024 + i);
+                for (size_t j = 0; j < c->samples.size(); ++j)
+                        c->samples[j] = int32_t(1000 * sin(j * 0.01 * (i + 1)));
+                enc.submit(c);
+                while ((c = enc.next(i + 1 == nchunks))) {
+                        vector<int32_t> y;
+                        dsp::rice_codec::decode(&c->data[0], c->data.size(), y);
+                        assert(y.size() == 1024 + collected);
+                        assert(y == c->samples);
+                        enc.release(c);
+                        collected += 1;
+                }
+        }
+        assert(collected == nchunks);
+        assert(enc.pending() == 0);
+}
+
+int main(int, char**)
+{
+        srand(1);
+        vector<int32_t> x(4096);
+
+        // tone plus a bit of noise, 16 bits
+        for (size_t i = 0; i < x.size(); ++i)
+                x[i] = int32_t(8000 * sin(i * 0.05) + (rand() % 64) - 32);
+        double ratio = roundtrip(x);
+        cout << "tone + noise: " << ratio << endl;
+        assert(ratio > 2.0);
+
+        // full-scale 24-bit noise, which needs escapes
+        for (size_t i = 0; i < x.size(); ++i)
+                x[i] = (rand() % (1 << 24)) - (1 << 23);
+        roundtrip(x);
+
+        // silence, short chunks, and partial partitions
+        fill(x.begin(), x.end(), 0);
+        assert(roundtrip(x) > 100);
+        for (size_t n = 1; n < 10; ++n) {
+                vector<int32_t> y(x.begin(), x.begin() + n);
+                y[0] = -5;
+                roundtrip(y);
+        }
+        x.resize(1000);
+        roundtrip(x);
+
+        // truncated chunk
+        vector<char> buf;
+        dsp::rice_codec::encode(&x[0], x.size(), buf);
+        vector<int32_t> y;
+        try {
+                dsp::rice_codec::decode(&buf[0], 3, y);
+                assert(false);
+        }
+        catch (std::runtime_error const &) {}
+
+        test_encoder(1, 20);
+        test_encoder(4, 100);
+
+        cout << "rice codec tests passed" << endl;
+}
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+
+#include "jill/dsp/sample_convert.hh"
+
+using namespace std;
+using namespace jill;
+
+const size_t nsamples = 4096;
+
+template <typename Traits>
+void test_convert(bool dither)
+{
+        typedef typename Traits::value_type value_type;
+        sample_t in[nsamples];
+        value_type out[nsamples];
+        boost::uint32_t counter = 0;
+
+        for (size_t i = 0; i < nsamples; ++i) {
+                in[i] = sin(i * 0.01) * 0.9;
+        }
+        size_t clipped = dsp::float_to_int<Traits>(in, out, nsamples, dither, counter);
+        assert(clipped == 0);
+        assert(counter == nsamples);
+        for (size_t i = 0; i < nsamples; ++i) {
+                double err = out[i] - in[i] * Traits::full_scale();
+                assert(fabs(err) <= (dither ? 1.5 : 0.5));
+        }
+
+        // values out of range are clipped and counted
+        in[0] = 1.5;
+        in[1] = -2.0;
+        in[2] = 1.0;
+        clipped = dsp::float_to_int<Traits>(in, out, nsamples, dither, counter);
+        assert(clipped == 3);
+        assert(out[0] == Traits::max());
+        assert(out[1] == Traits::min());
+        assert(out[2] == Traits::max());
+        assert(counter == 2 * nsamples);
+}
+
+int main(int, char**)
+{
+        test_convert<dsp::int16_sample>(false);
+        test_convert<dsp::int16_sample>(true);
+        test_convert<dsp::int24_sample>(false);
+        test_convert<dsp::int24_sample>(true);
+        cout << "sample conversion tests passed" << endl;
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "jill/dsp/threshold_gate.hh"
+
+using namespace std;
+using namespace jill;
+using dsp::threshold_gate;
+
+const sample_t thresh = 0.5;
+
+/* a sine with slowly varying amplitude, so the gate opens and closes */
+vector<sample_t> make_signal(size_t nsamples)
+{
+        vector<sample_t> x(nsamples);
+        for (size_t i = 0; i < nsamples; ++i)
+                x[i] = sin(i * 0.05) * (0.6 + 0.5 * sin(i * 0.003)) + 0.02 * (drand48() - 0.5);
+        return x;
+}
+
+bool passes(threshold_gate::mode_type mode, sample_t x, sample_t t)
+{
+        if (mode == threshold_gate::ABOVE) return x > t;
+        else if (mode == threshold_gate::BELOW) return x < t;
+        else return fabs(x) > t;
+}
+
+/* the gate as a plain per-sample loop */
+vector<sample_t> reference(threshold_gate::mode_type mode, vector<sample_t> const & x,
+                           sample_t hyst, nframes_t attack, nframes_t release)
+{
+        sample_t close = (mode == threshold_gate::BELOW) ? thresh + hyst : thresh - hyst;
+        float up = attack ? 1.0f / attack : 1.0f;
+        float down = release ? 1.0f / release : 1.0f;
+        bool open = false;
+        float gain = 0;
+        vector<sample_t> out(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+                open = passes(mode, x[i], open ? close : thresh);
+                gain = open ? min(gain + up, 1.0f) : max(gain - down, 0.0f);
+                out[i] = x[i] * gain;
+        }
+        return out;
+}
+
+/* run the gate in blocks of period samples and compare against the reference */
+void test_gate(threshold_gate::mode_type mode, sample_t hyst, nframes_t attack,
+               nframes_t release, size_t period)
+{
+        vector<sample_t> x = make_signal(10000);
+        vector<sample_t> y(x.size());
+        threshold_gate gate(mode, thresh, hyst, attack, release);
+        assert(gate.mode() == mode);
+        threshold_gate::state s = threshold_gate::initial_state();
+        for (size_t i = 0; i < x.size(); i += period)
+                gate.process(s, &x[i], &y[i], min(period, x.size() - i));
+
+        vector<sample_t> r = reference(mode, x, hyst, attack, release);
+        size_t npass = 0;
+        for (size_t i = 0; i < x.size(); ++i) {
+                assert(fabs(y[i] - r[i]) < 1e-5);
+                npass += (y[i] != 0);
+        }
+        assert(npass > 0);
+}
+
+/* the gain never jumps by more than the ramp allows */
+void test_ramp(nframes_t attack, nframes_t release)
+{
+        vector<sample_t> x(2000, 0.0f);
+        for (size_t i = 500; i < 1500; ++i) x[i] = 1.0f;
+        vector<sample_t> y(x.size());
+        threshold_gate gate(threshold_gate::ABOVE, thresh, 0, attack, release);
+        threshold_gate::state s = threshold_gate::initial_state();
+        gate.process(s, &x[0], &y[0], x.size());
+        assert(y[500] > 0 && y[500] <= 1.0f / attack + 1e-6);
+        assert(y[500 + attack] == 1.0f);
+        for (size_t i = 501; i < 1500; ++i)
+                assert(y[i] - y[i-1] <= 1.0f / attack + 1e-6);
+        // the input is zero after 1500, so check the gain directly
+        assert(s.gain == 0 && !s.open);
+}
+
+int main(int, char**)
+{
+        assert(threshold_gate::parse_mode("abs") == threshold_gate::ABS);
+        try {
+                threshold_gate::parse_mode("sideways");
+                assert(false);
+        }
+        catch (std::invalid_argument const &) {}
+
+        threshold_gate::mode_type modes[] = { threshold_gate::ABOVE, threshold_gate::BELOW,
+                                              threshold_gate::ABS };
+        for (int m = 0; m < 3; ++m) {
+                test_gate(modes[m], 0, 0, 0, 1024);
+                test_gate(modes[m], 0.2, 0, 0, 1024);
+                test_gate(modes[m], 0.2, 0, 0, 13);
+                test_gate(modes[m], 0.1, 48, 240, 64);
+                test_gate(modes[m], 0, 10, 10, 7);
+        }
+        test_ramp(48, 240);
+        test_ramp(1, 100);
+        cout << "threshold gate tests passed" << endl;
+}
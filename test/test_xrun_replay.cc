@@ -0,0 +1,425 @@
+/*
+ * Deterministic xrun injection and replay. Drives buffered_data_writer or
+ * triggered_data_writer with an arf_writer, injecting xruns, buffer size
+ * changes, resets and a shutdown at scripted periods, the same way jrecord's
+ * JACK callbacks would. Before each injected event the harness waits for the
+ * disk thread to consume everything, so the same script always produces the
+ * same file. Each sample encodes its frame number (modulo 2^16), so the
+ * written entries can then be checked for frame continuity: every gap in a
+ * channel must be in an entry tagged with jill_error, and (in buffered mode)
+ * every frame pushed before the shutdown must be stored. The time from each
+ * xrun to the writer handling it and to the next block being written is
+ * reported as the recovery cost.
+ *
+ * The -V option only validates an existing file (for example, one recorded by
+ * jrecord from a live server while test_xrun provokes xruns). Files that don't
+ * encode frame numbers will report gaps everywhere, so in that case only the
+ * channel lengths and tags are meaningful.
+ *
+ * Usage: test_xrun_replay [-t] [-c nchannels] [-p period] [-n periods]
+ *                         [-e script] [-o file.arf] [-k]
+ *        test_xrun_replay -V file.arf
+ *
+ *  -t  use triggered_data_writer (the trigger turns on after each new entry)
+ *  -c  number of channels (default 2)
+ *  -p  initial period size (default 1024)
+ *  -n  the number of periods to push (default 120)
+ *  -e  the script: comma-separated PERIOD:ACTION items, where ACTION is
+ *      xrun[=K] (an xrun losing K periods, default 1), bufsize=N (the period
+ *      size changes to N), reset (start a new entry), or shutdown (the server
+ *      shuts the client down; later periods are dropped)
+ *  -o  the ARF file (default test_xrun_replay.arf)
+ *  -k  keep the file after validating it
+ */
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+#include <hdf5.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/filesystem.hpp>
+
+#include "jill/midi.hh"
+#include "jill/file/arf_writer.hh"
+#include "jill/dsp/block_ringbuffer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+#include "jill/dsp/triggered_data_writer.hh"
+#include "test/harness.hh"
+
+using namespace std;
+using namespace jill;
+
+char const * default_script = "20:xrun=3,35:bufsize=256,50:reset,50:xrun,70:xrun=2,"
+        "71:xrun,90:bufsize=512,91:xrun,110:shutdown";
+nframes_t const sampling_rate = 48000;
+nframes_t const frame_modulus = 65536;
+char const * trigger_id = "trig";
+
+size_t nchannels = 2;
+nframes_t period_size = 1024;
+size_t nperiods = 120;
+bool triggered = false;
+
+double
+now()
+{
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* passes data to another writer, timing how long it takes to recover from xruns */
+class timing_writer : public test::passthrough_writer {
+public:
+        timing_writer(boost::shared_ptr<data_writer> w)
+                : passthrough_writer(w), xruns(0), handled(0), resumed(0), injected(0),
+                  _waiting(false) {}
+        void xrun() {
+                passthrough_writer::xrun();
+                handled += now() - injected;
+                _waiting = true;
+                __sync_add_and_fetch(&xruns, 1);
+        }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) {
+                passthrough_writer::write(data, start, stop);
+                if (_waiting) {
+                        resumed += now() - injected;
+                        _waiting = false;
+                }
+        }
+
+        int xruns;                      // xruns seen by the writer
+        double handled;                 // total time from injection to xrun()
+        double resumed;                 // total time from injection to the next write()
+        double injected;                // when the last xrun was injected
+private:
+        bool _waiting;
+};
+
+struct event {
+        size_t period;
+        string action;
+        long arg;
+};
+
+vector<event>
+parse_script(string const & script)
+{
+        vector<event> out;
+        string::size_type pos = 0;
+        while (pos < script.size()) {
+                string::size_type end = script.find(',', pos);
+                if (end == string::npos) end = script.size();
+                string item = script.substr(pos, end - pos);
+                pos = end + 1;
+                string::size_type colon = item.find(':');
+                if (colon == string::npos) {
+                        fprintf(stderr, "invalid script item: %s\n", item.c_str());
+                        exit(EXIT_FAILURE);
+                }
+                event e = { strtoul(item.c_str(), 0, 10), item.substr(colon + 1), 1 };
+                string::size_type eq = e.action.find('=');
+                if (eq != string::npos) {
+                        e.arg = atol(e.action.c_str() + eq + 1);
+                        e.action.erase(eq);
+                }
+                if (e.action != "xrun" && e.action != "bufsize" && e.action != "reset" &&
+                    e.action != "shutdown") {
+                        fprintf(stderr, "unknown action: %s\n", e.action.c_str());
+                        exit(EXIT_FAILURE);
+                }
+                out.push_back(e);
+        }
+        return out;
+}
+
+/* what the validator should find */
+struct expectation {
+        size_t nentries;        // 0 if not known
+        nframes_t nframes;      // per channel, 0 if not known
+        int xruns;
+};
+
+template <typename Thread>
+expectation
+replay(boost::shared_ptr<Thread> thread, timing_writer & timer, vector<event> const & script)
+{
+        expectation ex = { 1, 0, 0 };
+        vector<sample_t> data;
+        vector<string> ids(nchannels);
+        char buf[32];
+        for (size_t c = 0; c < nchannels; ++c) {
+                snprintf(buf, sizeof(buf), "pcm_%03zu", c);
+                ids[c] = buf;
+        }
+        midi::data_type onset[] = { midi::note_on, 0, 64 };
+
+        thread->start();
+        usleep(10000);          // let the thread start before any stop()
+
+        nframes_t time = 0;
+        bool stopped = false;
+        bool trigger = triggered;
+        vector<event>::const_iterator e = script.begin();
+        for (size_t p = 0; p < nperiods; ++p) {
+                for (; e != script.end() && e->period == p; ++e) {
+                        thread->await();
+                        if (e->action == "xrun" && !stopped) {
+                                timer.injected = now();
+                                time += e->arg * period_size;
+                                thread->xrun();
+                                ex.xruns += 1;
+                                while (__sync_add_and_fetch(&timer.xruns, 0) < ex.xruns) {
+                                        thread->data_ready();
+                                        usleep(100);
+                                }
+                        }
+                        else if (e->action == "bufsize" && !stopped) {
+                                // what jrecord does in its buffer size callback
+                                period_size = e->arg;
+                                thread->request_buffer_size(nchannels * period_size *
+                                                            sizeof(sample_t) * 64);
+                                thread->reset();
+                                ex.nentries += 1;
+                                trigger = triggered;
+                        }
+                        else if (e->action == "reset" && !stopped) {
+                                thread->reset();
+                                ex.nentries += 1;
+                                trigger = triggered;
+                        }
+                        else if (e->action == "shutdown") {
+                                thread->stop();
+                                stopped = true;
+                        }
+                }
+                if (trigger) {
+                        thread->push(time, EVENT, trigger_id, 3, onset);
+                        trigger = false;
+                }
+                data.resize(period_size);
+                for (nframes_t i = 0; i < period_size; ++i)
+                        data[i] = (time + i) % frame_modulus;
+                for (size_t c = 0; c < nchannels; ++c)
+                        thread->push(time, SAMPLED, ids[c].c_str(),
+                                     period_size * sizeof(sample_t), &data[0]);
+                thread->data_ready();
+                if (!stopped) {
+                        thread->await();
+                        ex.nframes += period_size;
+                }
+                time += period_size;
+        }
+        if (!stopped) thread->stop();
+        thread->join();
+
+        // triggered entries include pretrigger data and split on trigger events
+        if (triggered) ex.nentries = ex.nframes = 0;
+        return ex;
+}
+
+/* -- validation -- */
+
+struct channel {
+        string name;
+        vector<float> samples;
+};
+
+struct entry {
+        string name;
+        unsigned long long jack_frame;
+        bool tagged;
+        vector<channel> channels;
+};
+
+herr_t
+collect_datasets(hid_t group, char const * name, H5L_info_t const *, void * arg)
+{
+        vector<channel> * channels = static_cast<vector<channel>*>(arg);
+        hid_t obj = H5Oopen(group, name, H5P_DEFAULT);
+        if (obj < 0) return 0;
+        if (H5Iget_type(obj) == H5I_DATASET) {
+                hid_t type = H5Dget_type(obj);
+                if (H5Tget_class(type) == H5T_FLOAT) {
+                        channel c;
+                        c.name = name;
+                        hid_t space = H5Dget_space(obj);
+                        c.samples.resize(H5Sget_simple_extent_npoints(space));
+                        if (!c.samples.empty())
+                                H5Dread(obj, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                                        &c.samples[0]);
+                        H5Sclose(space);
+                        channels->push_back(c);
+                }
+                H5Tclose(type);
+        }
+        H5Oclose(obj);
+        return 0;
+}
+
+herr_t
+collect_entries(hid_t file, char const * name, H5L_info_t const *, void * arg)
+{
+        vector<entry> * entries = static_cast<vector<entry>*>(arg);
+        hid_t obj = H5Oopen(file, name, H5P_DEFAULT);
+        if (obj < 0) return 0;
+        if (H5Iget_type(obj) == H5I_GROUP && H5Aexists(obj, "jack_frame") > 0) {
+                entry e;
+                e.name = name;
+                hid_t attr = H5Aopen(obj, "jack_frame", H5P_DEFAULT);
+                H5Aread(attr, H5T_NATIVE_ULLONG, &e.jack_frame);
+                H5Aclose(attr);
+                e.tagged = H5Aexists(obj, "jill_error") > 0;
+                H5Literate(obj, H5_INDEX_NAME, H5_ITER_INC, 0, collect_datasets, &e.channels);
+                entries->push_back(e);
+        }
+        H5Oclose(obj);
+        return 0;
+}
+
+/* returns the number of failures */
+int
+validate(string const & path, expectation const & ex)
+{
+        hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file < 0) {
+                printf("FAIL: unable to open %s\n", path.c_str());
+                return 1;
+        }
+        vector<entry> entries;
+        H5Literate(file, H5_INDEX_NAME, H5_ITER_INC, 0, collect_entries, &entries);
+        H5Fclose(file);
+
+        int failures = 0, tags = 0, spurious = 0;
+        nframes_t total = 0;
+        printf("entry\tjack_frame\tchannels\tframes\tgaps\ttagged\n");
+        for (vector<entry>::const_iterator e = entries.begin(); e != entries.end(); ++e) {
+                size_t gaps = 0, nframes = 0;
+                bool unequal = false, misaligned = false;
+                for (vector<channel>::const_iterator c = e->channels.begin();
+                     c != e->channels.end(); ++c) {
+                        vector<float> const & x = c->samples;
+                        if (c == e->channels.begin()) nframes = x.size();
+                        else if (x.size() != nframes) unequal = true;
+                        if (x.empty()) continue;
+                        if (c->name.compare(0, 4, "pcm_") == 0 &&
+                            x[0] != float(e->jack_frame % frame_modulus))
+                                misaligned = true;
+                        size_t g = 0;
+                        for (size_t i = 1; i < x.size(); ++i) {
+                                if (nframes_t(x[i]) != (nframes_t(x[i-1]) + 1) % frame_modulus)
+                                        ++g;
+                        }
+                        gaps = std::max(gaps, g);
+                }
+                total += nframes;
+                tags += e->tagged;
+                printf("%s\t%llu\t%zu\t%zu\t%zu\t%s\n", e->name.c_str(), e->jack_frame,
+                       e->channels.size(), nframes, gaps, e->tagged ? "yes" : "no");
+                if (unequal) {
+                        printf("FAIL: %s: channels have different lengths\n", e->name.c_str());
+                        ++failures;
+                }
+                if (misaligned && !triggered) {
+                        printf("FAIL: %s: first sample doesn't match jack_frame\n",
+                               e->name.c_str());
+                        ++failures;
+                }
+                if (gaps > 0 && !e->tagged) {
+                        printf("FAIL: %s: %zu gaps but no jill_error tag\n", e->name.c_str(), gaps);
+                        ++failures;
+                }
+                if (gaps == 0 && e->tagged) ++spurious;
+        }
+        if (ex.nentries && entries.size() != ex.nentries) {
+                printf("FAIL: expected %zu entries, found %zu\n", ex.nentries, entries.size());
+                ++failures;
+        }
+        if (ex.nframes && total != ex.nframes) {
+                printf("FAIL: expected %u frames per channel, found %u\n", ex.nframes, total);
+                ++failures;
+        }
+        if (tags == 0 && ex.xruns > 0) {
+                printf("FAIL: %d xruns but no entries are tagged\n", ex.xruns);
+                ++failures;
+        }
+        printf("# %zu entries, %u frames, %d tagged (%d without gaps)\n", entries.size(), total,
+               tags, spurious);
+        return failures;
+}
+
+int
+main(int argc, char **argv)
+{
+        string script = default_script;
+        string path = "test_xrun_replay.arf";
+        string validate_only;
+        bool keep = false;
+        int c;
+        while ((c = getopt(argc, argv, "tc:p:n:e:o:kV:")) != -1) {
+                switch (c) {
+                case 't': triggered = true; break;
+                case 'c': nchannels = atoi(optarg); break;
+                case 'p': period_size = atoi(optarg); break;
+                case 'n': nperiods = atoi(optarg); break;
+                case 'e': script = optarg; break;
+                case 'o': path = optarg; break;
+                case 'k': keep = true; break;
+                case 'V': validate_only = optarg; break;
+                default:
+                        fprintf(stderr, "see the comment at the top of %s.cc for usage\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (!validate_only.empty()) {
+                expectation none = { 0, 0, 0 };
+                return validate(validate_only, none) ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        vector<event> events = parse_script(script);
+        printf("# %s, %zu channels, script: %s\n",
+               triggered ? "triggered_data_writer" : "buffered_data_writer", nchannels,
+               script.c_str());
+
+        expectation ex;
+        test::fixed_source source("test_xrun_replay", sampling_rate);
+        boost::shared_ptr<timing_writer> timer;
+        {
+                std::map<string, string> attrs;
+                boost::shared_ptr<data_writer> sink(new file::arf_writer(path, source, attrs, 0));
+                timer.reset(new timing_writer(sink));
+                size_t bytes = nchannels * period_size * sizeof(sample_t) * 64;
+                if (triggered) {
+                        typedef test::monitored<dsp::triggered_data_writer> thread_type;
+                        boost::shared_ptr<thread_type> thread(
+                                new thread_type(timer, string(trigger_id), period_size * 4,
+                                                period_size * 4));
+                        thread->request_buffer_size(bytes);
+                        ex = replay(thread, *timer, events);
+                }
+                else {
+                        typedef test::monitored<dsp::buffered_data_writer> thread_type;
+                        boost::shared_ptr<thread_type> thread(new thread_type(timer, bytes));
+                        ex = replay(thread, *timer, events);
+                }
+                timer->_w.reset();      // closes the file
+        }
+        if (ex.xruns > 0)
+                printf("# recovery: xrun handled after %.1f us, writing resumed after %.1f us "
+                       "(mean of %d)\n", timer->handled / ex.xruns * 1e6,
+                       timer->resumed / ex.xruns * 1e6, ex.xruns);
+
+        int failures = validate(path, ex);
+        if (!keep) boost::filesystem::remove(path);
+        if (failures) {
+                printf("%d failures\n", failures);
+                return EXIT_FAILURE;
+        }
+        printf("passed\n");
+        return EXIT_SUCCESS;
+}